@@ -1,5 +1,11 @@
 #include <iostream>
 #include <cstdlib>
+#include <cfloat>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #define STB_IMAGE_IMPLEMENTATION
@@ -13,6 +19,63 @@
 //Sphere header
 #include "sphere.h"
 
+//Mesh registry header
+#include "meshRegistry.h"
+
+//Shader program headers
+#include "shaderProgram.h"
+#include "shaderVariants.h"
+
+//Render queue header
+#include "renderQueue.h"
+
+//Per-frame uniform block header
+#include "frameUniforms.h"
+
+//Ring buffer header
+#include "ringBuffer.h"
+
+//Texture array header
+#include "textureArrays.h"
+
+//Scene graph header
+#include "sceneGraph.h"
+
+//Scene file header
+#include "sceneFile.h"
+
+//Frustum culling header
+#include "frustumCulling.h"
+
+//BVH headers
+#include "bvh.h"
+#include "bvhBenchmark.h"
+
+//Occlusion culling header
+#include "occlusionCulling.h"
+
+//Level of detail header
+#include "lod.h"
+
+//Shadow map header
+#include "shadowMap.h"
+
+//Clustered lighting header
+#include "lightClusters.h"
+
+//Lightmap baker header
+#include "lightmapBaker.h"
+
+//Job system header
+#include "jobSystem.h"
+
+//Frame pipeline headers
+#include "tripleBuffer.h"
+#include "spscRing.h"
+
+//Logging header
+#include "logger.h"
+
 //Camera header
 #include "camera.h"
 
@@ -28,47 +91,225 @@ namespace {
 	const int winWidth = 800;
 	const int winHeight = 600;
 
-	int p = 2; //Initialize int p to an even integer. p will later be used to switch between projection styles
+	//Framebuffer size in pixels, which is what gl_FragCoord counts in and differs from the window size on high DPI displays.
+	//Written by the GL thread on resize, read by whichever thread builds the frame
+	std::atomic<int> framebufferWidth(winWidth);
+	std::atomic<int> framebufferHeight(winHeight);
 
-	//Create struct to contain mesh data
-	struct Mesh {
-		GLuint vao; //Vertex Array Object
-		GLuint vbos[3]; //Vertex Buffer Object
-		GLuint nIndices;
-		GLuint numVertices; //Number of vertices
-	};
+	int p = 2; //Initialize int p to an even integer. p will later be used to switch between projection styles
 
-	//Sphere uses its own seprate vao, vbo, and indices
-	GLuint sphereVaoID;
-	GLuint sphereVboID;
-	GLuint sphereIboID;
 	//Main GLFW window
 	GLFWwindow* gWindow = nullptr;
 
-	//Mesh shapes
-	Mesh cube;
-	Mesh cylinder;
-	Mesh Torus;
-	Mesh plane;
-	Mesh pyramid;
-	Sphere sphere;
-
-	//Texture IDs, scale, and wrap mode
-	GLuint mugTextureID;
-	GLuint planeTextureID;
-	GLuint coverTextureID;
-	GLuint paperTextureID;
-	GLuint pencilTextureID;
-	GLuint pencilTipTextureID;
-	GLuint eraserTextureID;
-	GLuint teaPotTextureID;
-	GLuint plasticTextureID;
+	//Scene loaded at startup, overridden with --scene <path>. --replicate <n> lays out n by n copies of it
+	const char* scenePath = "Scenes/desk.scene";
+	unsigned int sceneCopies = 1;
+
+	//Every shape is packed into one shared vertex and index buffer at startup, render() only draws through these handles
+	MeshRegistry meshes;
+	std::vector<LodChain> sceneLods; //Indexed by the scene's mesh index, shapes without parameters have a single level
+	MeshHandle lightCubeMesh;
+
+	//Dimensions of the parametric shapes, their LOD chains measure tessellation error against these
+	const float cylinderRadius = 0.25f;
+	const float torusInRadius = 0.08f;
+	const float torusOutRadius = 0.8f;
+
+	//Per-draw model matrices, tints and material IDs for the whole frame
+	InstanceBuffer instances;
+
+	//Instances, indirect commands and the FrameBlock are written straight into one persistently mapped buffer,
+	//with a section for each frame the GPU may still be reading
+	RingBuffer frameRing;
+
+	//Draws are collected here each frame and sorted by state before they are issued
+	RenderQueue queue;
+	FrameStatsReporter statsReporter;
+
+	//Static desk scene, world matrices are cached in the graph and only recomputed when a node changes
+	const unsigned int NO_LOD_CHAIN = ~0u;
+	struct SceneObject {
+		NodeHandle node;
+		MeshHandle mesh; //Finest level, its bounds stand in for every level
+		unsigned int features; //ShaderFeature bits the object's material needs
+		ProgramSlot program; //The scene shader variant compiled with those features
+		TextureSlot texture;
+		unsigned int lodChain; //Index into sceneLods, NO_LOD_CHAIN to always draw mesh
+		unsigned int lodLevel; //Level drawn last frame, the selection's hysteresis starts from it
+		GLuint lightmap; //Baked lightmap ID, 0 when lit at runtime
+	};
+	SceneGraph scene;
+	std::vector<SceneObject> sceneObjects;
+	NodeHandle lightNode;
+
+	//World bounding spheres and boxes of sceneObjects, refreshed only for objects whose node moved
+	CullingTable cullingTable;
+	std::vector<Aabb> objectBounds;
+
+	//Scenes with at least this many objects are culled through the BVH, smaller ones through the linear SIMD table
+	const unsigned int bvhObjectThreshold = 256;
+	Bvh bvh;
+
+	//Objects smaller than occludeeRadius are drawn under conditional rendering, larger ones act as occluders.
+	//O toggles the mode
+	const float occludeeRadius = 1.5f;
+	bool occlusionEnabled = true;
+	bool occlusionKeyDown = false;
+	OcclusionCuller occlusion;
+	std::vector<float> objectRadii;
+	double occlusionMs = 0.0;
+
+	//Worker threads refresh bounds, cull and build draw packets, the GL thread only merges their lists and draws.
+	//--threads <n> sets the thread count, every hardware thread by default
+	JobSystem jobs;
+	unsigned int jobThreads = 0;
+	const unsigned int jobGrain = 256; //Objects per chunk, a multiple of CullingTable::LANES
+	struct FrameWork {
+		std::vector<unsigned int> visible;
+		std::vector<unsigned int> occlusionTested;
+		unsigned int trianglesSaved;
+		bool boundsChanged;
+	};
+	std::vector<FrameWork> frameWork; //One per job thread
+	std::vector<RenderList> threadLists; //Same indexing
+	std::vector<unsigned int> subtreeRoots;
+
+	//Each object picks the coarsest level whose error covers at most one pixel, overridden with --lod-error <pixels>
+	LodSelector lodSelector;
+	std::vector<glm::vec3> objectCenters;
+	std::vector<float> objectScales; //World radius over mesh radius, how much the node enlarges a level's error
+
+	//The simulation thread builds frame N + 1 while the GL thread submits frame N. Input reaches it through
+	//a lock-free event ring, finished frames come back through a lock-free triple buffer.
+	//--no-pipeline builds and submits every frame on the GL thread instead
+	struct ViewInput {
+		glm::vec3 position;
+		glm::mat4 view;
+		float zoom;
+		bool orthographic;
+		bool occlusion;
+		int framebufferWidth;
+		int framebufferHeight;
+	};
+	struct FrameSnapshot {
+		FrameUniforms uniforms;
+		bool occlusion;
+		RenderList items; //Sorted, occlusion conditions are filled in on the GL thread
+		std::vector<unsigned int> occlusionTested;
+		std::vector<Aabb> occlusionBoxes; //World box of each tested object
+		RenderList shadowCasters; //Empty unless the shadow map has to be redrawn this frame
+		ClusterLists clusters;
+		double clusterMs;
+		unsigned int matricesComputed;
+		unsigned int objectsCulled;
+		unsigned int lodTrianglesSaved;
+		unsigned int inputEvents;
+		double buildMs;
+	};
+	bool pipelined = true;
+	TripleBuffer<FrameSnapshot> snapshots;
+	FrameSnapshot serialFrame;
+	std::thread simulationThread;
+	std::atomic<bool> simulationStopping(false);
+	double snapshotWaitMs = 0.0;
+	//Snapshots change hands through the triple buffer's atomics alone. A thread with nothing to do sleeps on this condition
+	//and is woken by wakePipeline after the other side published or took a snapshot, asked to stop or asked for a redraw
+	std::mutex pipelineWakeMutex;
+	std::condition_variable pipelineWake;
+	std::atomic<unsigned int> simulationWakeups(0); //Times the simulation thread checked whether its snapshot was taken
+
+	//--on-demand only draws while something changed. Otherwise the GL thread sleeps in glfwWaitEventsTimeout
+	//and the simulation thread sleeps on pipelineWake, parked on a snapshot nobody takes, so an idle scene costs no CPU.
+	//A change keeps drawing for a few frames: the pipelined frame lags input by one, and occlusion results by one more
+	bool onDemand = false;
+	const int REDRAW_FRAMES = 3;
+	const double IDLE_TIMEOUT = 0.5; //Seconds between wake-ups while idle
+	//A parked simulation thread checks its snapshot when it finishes building and otherwise only when woken,
+	//more checks than this over one idle wait mean it is polling instead of sleeping
+	const unsigned int IDLE_WAKEUP_LIMIT = 4;
+	int redrawFrames = REDRAW_FRAMES; //Frames still to draw, only touched on the GL thread
+
+	//The scene's textures packed into arrays by size, scale, and wrap mode.
+	//--separate-textures gives every texture an array of its own
+	TextureArraySet textureArrays;
+	bool separateTextures = false;
 	glm::vec2 gUVScale(1.0f, 1.0f);
 	GLint gTexWrapMode = GL_REPEAT;
 
-	//Shader programs
-	GLuint lightProgramID;
-	GLuint programID;
+	//Render queue slots of the texture layers above, indexed by the scene's texture index
+	TextureSlot noTextureSlot;
+	std::vector<TextureSlot> textureSlots;
+
+	//Linked programs are saved here and loaded back on the next launch, --no-shader-cache always compiles from source
+	const char* const shaderCacheDirectory = "ShaderCache";
+	bool shaderCacheEnabled = true;
+	ProgramCache programCache;
+
+	//Shader programs. The scene's objects draw with the variant of the scene shaders their material needs,
+	//each variant registered with the render queue once, so its slot is part of the sort key
+	ShaderVariants sceneShaders;
+	ProgramSlot variantSlots[ShaderVariants::VARIANT_COUNT];
+	ShaderProgram proxyProgram;
+
+	//Camera and light values both programs read from the FrameBlock uniform block
+	FrameUniformBuffer frameUniformBuffer;
+
+	//Shadows of the lit objects from gLightPos. The map is drawn through a queue of its own with a depth-only program,
+	//and only on frames where the light or an object moved, so a static scene pays nothing for it after the first frame
+	const GLsizei shadowMapSize = 2048;
+	ShadowMap shadowMap;
+	ShaderProgram shadowProgram;
+	RenderQueue shadowQueue;
+	ProgramSlot shadowSlot;
+	TextureSlot shadowTextureSlot;
+	bool shadowCached = false; //Owned by the frame builder, like the light matrix below
+	glm::vec3 shadowLight;
+	glm::mat4 shadowLightSpace(1.0f);
+	std::vector<glm::vec3> shadowCorners; //Corners of every caster's box, what the light's frustum is fitted to
+	unsigned int shadowCasters = 0; //Casters the GL thread drew into the map this frame
+
+	//--lightmap bakes gLightPos's diffuse light, its shadows and two bounces into an atlas once at startup.
+	//Lit objects then only add the light's specular highlight at runtime, so the bake assumes the desk and the light stay put
+	bool lightmapsEnabled = false;
+	LightmapAtlas lightmapAtlas;
+
+	//Point lights besides gLightPos, shaded in one pass through per-cluster light lists.
+	//--lights <n> spreads n of them over the scene, --bench-lights ramps from 1 to LightClusters::MAX_LIGHTS.
+	//The GL thread only sets the count, the frame builder places the lights and bins them
+	LightClusters lightClusters;
+	LightClusterBuffer lightClusterBuffer;
+	std::atomic<unsigned int> pointLightCount(0);
+	unsigned int placedLights = 0;
+	const float clusterNear = 0.1f; //Near and far planes of both projections, the depth slices span them
+	const float perspectiveFar = 100.0f;
+	const float orthographicFar = 5.0f;
+
+	//Each --bench-lights step renders a warm-up, then measures, then doubles the light count
+	bool benchmarkLights = false;
+	const unsigned int lightBenchWarmup = 30;
+	const unsigned int lightBenchFrames = 120;
+	unsigned int lightBenchFrame = 0;
+	double lightBenchStart = 0.0;
+	double lightBenchClusterMs = 0.0;
+	unsigned int lightBenchVisible = 0;
+	unsigned int lightBenchEntries = 0;
+
+	//GLFW callbacks and takeInput only record compact events, the thread that builds frames drains them once per frame,
+	//adds up the movement, and updates the camera once. The camera, p, occlusionEnabled and moveSpeed belong to that thread
+	enum InputType {
+		INPUT_MOVE, //Key held for x seconds, direction is a Camera_Movement
+		INPUT_LOOK, //Cursor moved by x, y
+		INPUT_SCROLL, //Wheel moved by y steps
+		INPUT_TOGGLE_PROJECTION,
+		INPUT_TOGGLE_OCCLUSION
+	};
+	struct InputEvent {
+		unsigned char type;
+		unsigned char direction;
+		float x;
+		float y;
+	};
+	SpscRing<InputEvent, 4096> inputEvents;
 
 	// camera
 	Camera cam(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -84,115 +325,329 @@ namespace {
 
 	//Light color, position, and scale
 	glm::vec3 gLightColor(1.0f, 1.0f, 1.0f);
+	const float gAmbientStrength = 0.4f; //Ambient or global lighting strength, shared by the shader and the lightmap bake
 	glm::vec3 gLightPos(3.f, 5.f, 4.f);
 	glm::vec3 gLightScale(1.f);
 }
 
 bool initialize(int, char* [], GLFWwindow** window); //Initialize program
 void resizeWin(GLFWwindow* window, int width, int height); //Resize window when called
+void refreshWin(GLFWwindow* window); //Redraw window when the system asks for its contents
+void requestRedraw(); //Wakes --on-demand rendering for the next few frames
 void takeInput(GLFWwindow* window); //Processes user input
 void mousePosCallback(GLFWwindow* window, double x, double y); //Callback for glfwSetCursorPosCallback
 void mouseWheelCallback(GLFWwindow* window, double x, double y); //Callback for glfwScrollCallback
 void mouseClickCallback(GLFWwindow* window, int button, int input, int mods); //Callback for glfwSetMouseButtonCallback
-void buildCube(Mesh& cube);
-void buildCylinder(Mesh& Cylinder);
-void buildTorus(Mesh& Torus);
-void buildPlane(Mesh& plane);
-void buildPyramid(Mesh& pyramid);
-void buildSphere(Sphere& sphere);
-void destroyMeshes(Mesh& Cylinder, Mesh& Torus, Mesh& plane, Mesh& cube, Mesh& pyramid);
-bool createTexture(const char* fileName, GLuint& textureID);
-void destroyTexture(GLuint textureID);
-void render();
-bool buildShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programID);
-void destroyShaderProgram(GLuint programID);
-
-//Source code for vertex shader
+void buildCube(MeshData& cube);
+void buildCylinder(MeshData& Cylinder, int numSegments);
+void buildTorus(MeshData& Torus, int numSegments, int numSlices);
+void buildPlane(MeshData& plane);
+void buildPyramid(MeshData& pyramid);
+bool createTexture(const char* fileName, TextureArraySet& arrays, unsigned int& image);
+void buildCylinderLods(LodChain& chain, int numSegments);
+void buildTorusLods(LodChain& chain, int numSegments, int numSlices);
+void buildSphereLods(LodChain& chain, float radius, int numSectors, int numStacks);
+void buildSceneMeshes(const SceneFile& sceneFile);
+void addSceneNodes(SceneGraph& graph, const SceneFile& sceneFile, std::vector<NodeHandle>& nodes, NodeHandle root = ROOT_NODE);
+void buildScene(const SceneFile& sceneFile);
+void computeSceneBounds(const SceneFile& sceneFile, std::vector<Aabb>& bounds);
+void pushInput(InputType type, float x, float y = 0.0f, Camera_Movement direction = FORWARD);
+unsigned int applyInput(); //Drains the input ring into the camera, returns the number of events
+ViewInput readViewInput();
+void simulationLoop();
+FrameSnapshot& acquireSnapshot();
+void stopSimulation();
+void wakePipeline(); //Wakes a thread sleeping on the snapshot handoff
+void buildFrame(FrameSnapshot& frame);
+void buildPackets(FrameWork& work, RenderList& list, std::size_t firstVisible, const ViewInput& input);
+void buildShadowCasters(FrameSnapshot& frame, bool boundsChanged);
+ProgramSlot variantSlot(unsigned int features); //Requests the variant on first use
+unsigned int litFeatures(TextureSlot texture, bool lightmapped);
+void bakeLightmaps();
+Aabb litObjectBounds(); //Box around every lit object, inverted when there are none
+void placePointLights(unsigned int count);
+bool stepLightBenchmark(const FrameSnapshot& frame); //False once the last step is reported
+void render(FrameSnapshot& frame);
+
+//Source code for the scene's vertex shader. ShaderVariants defines TEXTURED, LIT, SPECULAR, SHADOWED and LIGHTMAPPED
+//as true or false after the #version line, the branches on them are resolved when the variant compiles
 const GLchar* vertShaderSource = GLSL(440,
 	layout(location = 0) in vec3 position;
 layout(location = 1) in vec2 textureCoordinate;
 layout(location = 2) in vec3 normal;
+layout(location = 3) in uint drawID; //Index of this instance's DrawData, starts at the command's baseInstance
+layout(location = 4) in vec2 lightmapCoordinate; //In lightmap cells
+
+struct DrawData {
+	mat4 model;
+	mat3 normalMatrix; //Moves normals to world space, computed on the CPU when the node moves
+	vec4 tint; //Color multiplier
+	uint materialID; //Layer of the bound texture array
+	uint lightmapID; //Entry of lightmapRects, 0 when lit at runtime
+};
+
+layout(std430, binding = 0) readonly buffer DrawBuffer {
+	DrawData draws[];
+};
+
+//Atlas rectangle of every lightmap ID, xy scales lightmap cells into the atlas and zw offsets them
+layout(std430, binding = 4) readonly buffer LightmapBuffer {
+	vec4 lightmapRects[];
+};
 
 out vec3 vertexFragmentPosition;
 out vec2 vertexTextureCoordinate;
 out vec3 vertexNormal;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+out vec4 vertexTint;
+flat out uint vertexMaterial;
+out vec4 vertexLightSpacePosition;
+out vec2 vertexLightmapCoordinate;
+
+layout(std140, binding = 0) uniform FrameBlock {
+	mat4 view;
+	mat4 projection;
+	vec4 viewPosition;
+	vec4 lightPosition;
+	vec4 lightColor;
+	vec2 uvScale;
+	float ambientStrength; //Fraction of lightColor every lit surface receives regardless of visibility
+	mat4 lightSpace;
+	vec4 clusterParams;
+};
 
 void main() {
-	gl_Position = projection * view * model * vec4(position, 1.0f);
-
-	vertexFragmentPosition = vec3(model * vec4(position, 1.0f));
+	vec4 worldPosition = draws[drawID].model * vec4(position, 1.0f);
+	gl_Position = projection * view * worldPosition;
+	vertexTint = draws[drawID].tint;
 
-	vertexTextureCoordinate = textureCoordinate;
-	vertexNormal = mat3(transpose(inverse(model))) * normal;
+	if (TEXTURED) {
+		vertexTextureCoordinate = textureCoordinate;
+		vertexMaterial = draws[drawID].materialID;
+	}
+	if (LIT) {
+		vertexFragmentPosition = vec3(worldPosition);
+		vertexNormal = draws[drawID].normalMatrix * normal;
+	}
+	if (SHADOWED) {
+		vertexLightSpacePosition = lightSpace * worldPosition;
+	}
+	if (LIGHTMAPPED) {
+		vec4 rect = lightmapRects[draws[drawID].lightmapID];
+		vertexLightmapCoordinate = rect.zw + lightmapCoordinate * rect.xy;
+	}
 }
 );
 
-//Source code for fragment shader
+//Source code for the scene's fragment shader, compiled with the same feature defines as the vertex shader
 const GLchar* fragmentShaderSource = GLSL(440,
 	in vec3 vertexNormal;
 in vec3 vertexFragmentPosition;
 in vec2 vertexTextureCoordinate;
+in vec4 vertexTint;
+flat in uint vertexMaterial;
+in vec4 vertexLightSpacePosition;
+in vec2 vertexLightmapCoordinate;
 
 out vec4 fragmentColor;
 
-uniform vec3 objectColor;
-uniform vec3 lightColor;
-uniform vec3 lightPos;
-uniform vec3 viewPosition;
-uniform sampler2D uTexture;
-uniform vec2 uvScale;
+layout(std140, binding = 0) uniform FrameBlock {
+	mat4 view;
+	mat4 projection;
+	vec4 viewPosition;
+	vec4 lightPosition;
+	vec4 lightColor;
+	vec2 uvScale;
+	float ambientStrength; //Fraction of lightColor every lit surface receives regardless of visibility
+	mat4 lightSpace;
+	vec4 clusterParams;
+};
 
-void main()
+uniform vec3 objectColor;
+uniform sampler2DArray uTexture;
+uniform sampler2DShadow uShadowMap;
+uniform sampler2D uLightmap; //rgb baked ambient, diffuse and bounced light, a whether the light reached the texel
+
+struct PointLight {
+	vec4 positionRadius;
+	vec4 color;
+};
+
+layout(std430, binding = 1) readonly buffer LightBuffer {
+	PointLight lights[];
+};
+
+//Offset into lightIndices and light count of every cluster
+layout(std430, binding = 2) readonly buffer ClusterBuffer {
+	uvec2 clusters[];
+};
+
+layout(std430, binding = 3) readonly buffer LightIndexBuffer {
+	uint lightIndices[];
+};
+
+//LightClusters::TILES_X, TILES_Y and SLICES
+const uint CLUSTER_TILES_X = 16u;
+const uint CLUSTER_TILES_Y = 9u;
+const uint CLUSTER_SLICES = 24u;
+
+//Diffuse and, with SPECULAR, highlights from the point lights listed for this fragment's cluster, each fading out at its radius
+vec3 clusteredLighting(vec3 norm, vec3 viewDir, float highlightSize)
 {
-	float ambientStrength = 0.4f; // Set ambient or global lighting strength
-	vec3 ambient = ambientStrength * lightColor; // Generate ambient light color
+	if (clusterParams.x <= 0.0f) {
+		return vec3(0.0f);
+	}
+	float depth = -(view * vec4(vertexFragmentPosition, 1.0f)).z;
+	uint x = min(uint(gl_FragCoord.x / clusterParams.x), CLUSTER_TILES_X - 1u);
+	uint y = min(uint(gl_FragCoord.y / clusterParams.y), CLUSTER_TILES_Y - 1u);
+	uint z = uint(clamp(log(depth / clusterParams.w) * clusterParams.z, 0.0f, float(CLUSTER_SLICES - 1u)));
+	uvec2 range = clusters[(z * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x];
+
+	vec3 result = vec3(0.0f);
+	for (uint i = 0u; i < range.y; i++) {
+		PointLight light = lights[lightIndices[range.x + i]];
+		vec3 toLight = light.positionRadius.xyz - vertexFragmentPosition;
+		float lightDistance = length(toLight);
+		float falloff = clamp(1.0f - lightDistance / light.positionRadius.w, 0.0f, 1.0f);
+		vec3 direction = toLight / max(lightDistance, 0.0001f);
+
+		float impact = max(dot(norm, direction), 0.0f);
+		float highlight = SPECULAR ? pow(max(dot(viewDir, reflect(-direction, norm)), 0.0f), highlightSize) : 0.0f;
+		result += falloff * falloff * (impact + highlight) * light.color.rgb;
+	}
+	return result;
+}
 
-	//Calculate Diffuse lighting*/
-	vec3 norm = normalize(vertexNormal);
-	vec3 lightDirection = normalize(lightPos - vertexFragmentPosition);
-	float impact = max(dot(norm, lightDirection), 0.0);
-	vec3 diffuse = impact * lightColor;
+//Fraction of the light that reaches the fragment, 3 by 3 comparisons that each blend four texels
+float lightVisibility()
+{
+	vec3 coordinate = vertexLightSpacePosition.xyz / vertexLightSpacePosition.w * 0.5f + 0.5f;
+	if (coordinate.z > 1.0f) {
+		return 1.0f;
+	}
 
-	//Calculate Specular lighting*/
-	float specularIntensity = 0.8f;
-	float highlightSize = 16.0f;
-	vec3 viewDir = normalize(viewPosition - vertexFragmentPosition);
-	vec3 reflectDir = reflect(-lightDirection, norm);
+	vec2 texel = 1.0f / vec2(textureSize(uShadowMap, 0));
+	float visibility = 0.0f;
+	for (int x = -1; x <= 1; x++) {
+		for (int y = -1; y <= 1; y++) {
+			visibility += texture(uShadowMap, vec3(coordinate.xy + vec2(x, y) * texel, coordinate.z));
+		}
+	}
+	return visibility / 9.0f;
+}
 
-	float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-	vec3 specular = specularIntensity * specularComponent * lightColor;
+void main()
+{
+	vec3 color = vertexTint.rgb;
+	if (TEXTURED) {
+		color *= texture(uTexture, vec3(vertexTextureCoordinate * uvScale, float(vertexMaterial))).rgb;
+	}
 
-	vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
+	if (LIT) {
+		vec3 ambient = ambientStrength * lightColor.rgb; // Generate ambient light color
+
+		//Calculate Diffuse lighting*/
+		vec3 norm = normalize(vertexNormal);
+		vec3 lightDirection = normalize(lightPosition.xyz - vertexFragmentPosition);
+		float impact = max(dot(norm, lightDirection), 0.0);
+		vec3 diffuse = impact * lightColor.rgb;
+
+		//Calculate Specular lighting*/
+		float specularIntensity = 0.8f;
+		float highlightSize = 16.0f;
+		vec3 viewDir = normalize(viewPosition.xyz - vertexFragmentPosition);
+		vec3 specular = vec3(0.0f);
+		if (SPECULAR) {
+			vec3 reflectDir = reflect(-lightDirection, norm);
+			float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
+			specular = specularIntensity * specularComponent * lightColor.rgb;
+		}
 
-	vec3 phong = (ambient + diffuse + specular) * textureColor.xyz;
+		//Shadow only takes away the light's direct contribution. Baked objects look everything up in the lightmap
+		//but the highlight, which moves with the camera
+		vec3 lighting;
+		if (LIGHTMAPPED) {
+			vec4 baked = texture(uLightmap, vertexLightmapCoordinate);
+			lighting = baked.rgb + baked.a * specular;
+		}
+		else {
+			float visibility = SHADOWED ? lightVisibility() : 1.0f;
+			lighting = ambient + visibility * (diffuse + specular);
+		}
+		lighting += clusteredLighting(norm, viewDir, highlightSize);
+		color *= lighting;
+	}
 
-	fragmentColor = vec4(phong, 1.0);
+	fragmentColor = vec4(color, 1.0);
 }
 );
 
-//Light shader source code
-const GLchar* lightVertexShaderSource = GLSL(440,
+//Occlusion proxy vertex shader source code, stretches the unit cube over an object's world box
+const GLchar* proxyVertexShaderSource = GLSL(440,
 	layout(location = 0) in vec3 position;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout(std140, binding = 0) uniform FrameBlock {
+	mat4 view;
+	mat4 projection;
+	vec4 viewPosition;
+	vec4 lightPosition;
+	vec4 lightColor;
+	vec2 uvScale;
+	float ambientStrength; //Fraction of lightColor every lit surface receives regardless of visibility
+	mat4 lightSpace;
+	vec4 clusterParams;
+};
+
+uniform vec3 boxMin;
+uniform vec3 boxMax;
 
 void main() {
-	gl_Position = projection * view * model * vec4(position, 1.0f);
+	gl_Position = projection * view * vec4(mix(boxMin, boxMax, position + 0.5f), 1.0f);
+}
+);
+
+//Occlusion proxy fragment shader source code, only depth testing matters
+const GLchar* proxyFragmentShaderSource = GLSL(440,
+	void main() {
 }
 );
 
-//Light fragment shader source code
-const GLchar* lightFragmentShaderSource = GLSL(440,
-	out vec4 fragmentColor;
+//Shadow caster vertex shader source code, places an instance in the light's clip space
+const GLchar* shadowVertexShaderSource = GLSL(440,
+	layout(location = 0) in vec3 position;
+layout(location = 3) in uint drawID;
+
+struct DrawData {
+	mat4 model;
+	mat3 normalMatrix;
+	vec4 tint;
+	uint materialID;
+	uint lightmapID;
+};
+
+layout(std430, binding = 0) readonly buffer DrawBuffer {
+	DrawData draws[];
+};
+
+layout(std140, binding = 0) uniform FrameBlock {
+	mat4 view;
+	mat4 projection;
+	vec4 viewPosition;
+	vec4 lightPosition;
+	vec4 lightColor;
+	vec2 uvScale;
+	float ambientStrength; //Fraction of lightColor every lit surface receives regardless of visibility
+	mat4 lightSpace;
+	vec4 clusterParams;
+};
 
 void main() {
-	fragmentColor = vec4(1.0f);
+	gl_Position = lightSpace * draws[drawID].model * vec4(position, 1.0f);
+}
+);
+
+//Shadow caster fragment shader source code, the map only stores depth
+const GLchar* shadowFragmentShaderSource = GLSL(440,
+	void main() {
 }
 );
 
@@ -215,94 +670,200 @@ void verticalFlip(unsigned char* image, int width, int height, int channels)
 }
 
 int main(int argc, char* argv[]) {
+	bool benchmarkBvh = false;
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--scene" && i + 1 < argc) {
+			scenePath = argv[++i];
+		}
+		else if (string(argv[i]) == "--lights" && i + 1 < argc) {
+			pointLightCount = min((unsigned int)max(0, atoi(argv[++i])), LightClusters::MAX_LIGHTS);
+		}
+		else if (string(argv[i]) == "--lightmap") {
+			lightmapsEnabled = true;
+		}
+		else if (string(argv[i]) == "--bench-lights") {
+			benchmarkLights = true;
+		}
+		else if (string(argv[i]) == "--bench-bvh") {
+			benchmarkBvh = true;
+		}
+		else if (string(argv[i]) == "--replicate" && i + 1 < argc) {
+			sceneCopies = max(1, atoi(argv[++i]));
+		}
+		else if (string(argv[i]) == "--threads" && i + 1 < argc) {
+			jobThreads = (unsigned int)max(0, atoi(argv[++i]));
+		}
+		else if (string(argv[i]) == "--on-demand") {
+			onDemand = true;
+		}
+		else if (string(argv[i]) == "--no-shader-cache") {
+			shaderCacheEnabled = false;
+		}
+		else if (string(argv[i]) == "--no-pipeline") {
+			pipelined = false;
+		}
+		else if (string(argv[i]) == "--separate-textures") {
+			separateTextures = true;
+		}
+		else if (string(argv[i]) == "--lod-error" && i + 1 < argc) {
+			lodSelector.setThreshold((float)atof(argv[++i]));
+		}
+		else if (string(argv[i]) == "--log" && i + 1 < argc) {
+			if (!logger.parseFilter(argv[++i])) {
+				cerr << "Unknown log filter " << argv[i] << ", expected <all|input|scene|render>=<debug|info|warning|error|off>" << endl;
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	logger.start();
+
+	//The benchmark only needs the scene's object boxes, so it runs without a window or GL context
+	if (benchmarkBvh) {
+		SceneFile sceneFile;
+		if (!sceneFile.load(scenePath)) {
+			return EXIT_FAILURE;
+		}
+		buildSceneMeshes(sceneFile);
+		vector<Aabb> layoutBounds;
+		computeSceneBounds(sceneFile, layoutBounds);
+		return runBvhBenchmark(layoutBounds);
+	}
+
 	//Create window to be displayed
 
 	if (!initialize(argc, argv, &gWindow)) {
 		return EXIT_FAILURE;
 	}
-	//Build shapes that are used to construct rest of meshes
-	buildCylinder(cylinder);
-	buildTorus(Torus);
-	buildPlane(plane);
-	buildPyramid(pyramid);
-	buildCube(cube);
 
-	if (!buildShaderProgram(vertShaderSource, fragmentShaderSource, programID)) {
+	//Load the scene description, from its compiled binary when that is up to date
+	SceneFile sceneFile;
+	if (!sceneFile.load(scenePath)) {
 		return EXIT_FAILURE;
 	}
 
-	if (!buildShaderProgram(lightVertexShaderSource, lightFragmentShaderSource, lightProgramID)) {
-		return EXIT_FAILURE;
-	}
+	//Build every mesh the scene asks for, the registry packs them into one vertex and one index buffer.
+	//Lightmapped meshes also keep their triangles for the baker
+	meshes.setLightmapped(lightmapsEnabled);
+	buildSceneMeshes(sceneFile);
+	meshes.upload();
 
-	//Load textures and report any textures that fail to load
-	const char* mugTextureName = "Textures/Gray Ceramic.png";
-	if (!createTexture(mugTextureName, mugTextureID)) {
-		cout << "Failed to load " << mugTextureName << endl;
-	}
-	else {
-		cout << "Texture " << mugTextureName << " loaded successfully" << endl;
-	}
-	const char* planeTextureName = "Textures/marble.jpg";
-	if (!createTexture(planeTextureName, planeTextureID)) {
-		cout << "Failed to load " << planeTextureName << endl;
-	}
-	else {
-		cout << "Texture " << planeTextureName << " loaded successfully" << endl;
-	}
-	const char* coverTexture = "Textures/notebook texture.jpg";
-	if (!createTexture(coverTexture, coverTextureID)) {
-		cout << "Failed to load " << coverTexture << endl;
-	}
-	else {
-		cout << "Texture " << coverTexture << " loaded successfully" << endl;
+	//The shared VAO reads each draw's ID from the instance stream, the shaders use it to index the DrawData buffer
+	instances.create();
+	meshes.attachInstances(instances);
+
+	if (shaderCacheEnabled) {
+		programCache.open(shaderCacheDirectory);
 	}
-	const char* paperTexture = "Textures/paper.jpg";
-	if (!createTexture(paperTexture, paperTextureID)) {
-		cout << "Failed to load " << paperTexture << endl;
+
+	//Scene shader variants start compiling as the scene asks for them and are finished together once it is laid out
+	if (ShaderVariants::enableParallelCompile()) {
+		cout << "Shader variants compile on the driver's threads" << endl;
 	}
-	else {
-		cout << "Texture " << paperTexture << " loaded successfully" << endl;
+	sceneShaders.setSource("scene", vertShaderSource, fragmentShaderSource, &programCache);
+
+	if (!proxyProgram.build("occlusion proxy", proxyVertexShaderSource, proxyFragmentShaderSource, &programCache)) {
+		return EXIT_FAILURE;
 	}
-	const char* pencilTexture = "Textures/pencil texture.png";
-	if (!createTexture(pencilTexture, pencilTextureID)) {
-		cout << "Failed to load " << pencilTexture << endl;
+	occlusion.create(proxyProgram, lightCubeMesh);
+
+	if (!shadowProgram.build("shadow", shadowVertexShaderSource, shadowFragmentShaderSource, &programCache)) {
+		return EXIT_FAILURE;
 	}
-	else {
-		cout << "Texture " << pencilTexture << " loaded successfully" << endl;
+	if (!shadowMap.create(shadowMapSize)) {
+		return EXIT_FAILURE;
 	}
-	const char* pencilTipTexture = "Textures/pencil tip texture.jpg";
-	if (!createTexture(pencilTexture, pencilTipTextureID)) {
-		cout << "Failed to load " << pencilTipTexture << endl;
+	shadowSlot = shadowQueue.addProgram(shadowProgram);
+	shadowTextureSlot = shadowQueue.addTexture(0);
+
+	frameUniformBuffer.create();
+	lightClusterBuffer.create();
+
+	//Load every texture the scene names and report any textures that fail to load
+	const unsigned int noImage = ~0u;
+	vector<unsigned int> textureImages;
+	textureArrays.setSeparate(separateTextures);
+	for (uint32_t i = 0; i < sceneFile.textureCount(); i++) {
+		const char* textureName = sceneFile.texture(i).path;
+		unsigned int image = noImage;
+		if (!createTexture(textureName, textureArrays, image)) {
+			cout << "Failed to load " << textureName << endl;
+		}
+		else {
+			cout << "Texture " << textureName << " loaded successfully" << endl;
+		}
+		textureImages.push_back(image);
 	}
-	else {
-		cout << "Texture " << pencilTipTexture << " loaded successfully" << endl;
+
+	//Same-sized textures become layers of one array, so a whole bucket of materials is drawn with a single bind
+	textureArrays.build(gTexWrapMode);
+	cout << textureImages.size() << " textures packed into " << textureArrays.getArrayCount() << " texture arrays" << endl;
+	noTextureSlot = queue.addTexture(0);
+	for (size_t i = 0; i < textureImages.size(); i++) {
+		if (textureImages[i] == noImage) {
+			textureSlots.push_back(noTextureSlot);
+			continue;
+		}
+		const TextureLayer& layer = textureArrays.getLayer(textureImages[i]);
+		textureSlots.push_back(queue.addTexture(layer.texture, layer.layer));
 	}
-	const char* eraserTexture = "Textures/eraser texture.png";
-	if (!createTexture(eraserTexture, eraserTextureID)) {
-		cout << "Failed to load " << eraserTexture << endl;
+
+	//Lay out the scene once, render() only reads the cached world matrices
+	buildScene(sceneFile);
+	sceneFile.close();
+	if (!queue.checkKeyRanges(meshes.size()) || !shadowQueue.checkKeyRanges(meshes.size())) {
+		return EXIT_FAILURE;
 	}
-	else {
-		cout << "Texture " << eraserTexture << " loaded successfully" << endl;
+
+	//Every object is submitted at most once a frame, plus once more on frames that redraw the shadow map,
+	//which bounds what one frame streams through the ring. The slack covers aligning each of the five allocations
+	GLsizeiptr frameBytes = sizeof(FrameUniforms) +
+		2 * sceneObjects.size() * (sizeof(InstanceData) + sizeof(DrawElementsIndirectCommand)) + 5 * 256 +
+		LightClusterBuffer::maxFrameBytes();
+	if (!frameRing.create(frameBytes)) {
+		return EXIT_FAILURE;
 	}
-	const char* teaPotTexture = "Textures/steel.jpg";
-	if (!createTexture(teaPotTexture, teaPotTextureID)) {
-		cout << "Failed to load " << teaPotTexture << endl;
+
+	jobs.start(jobThreads);
+	frameWork.resize(jobs.getThreadCount());
+	threadLists.resize(jobs.getThreadCount());
+	cout << sceneObjects.size() << " scene objects, frame built on " << jobs.getThreadCount() << " threads" << endl;
+
+	//Baked on the job threads before the simulation thread takes over the scene
+	bakeLightmaps();
+
+	//The driver compiled the variants the scene asked for while it was laid out and baked, wait for whatever is left
+	if (!sceneShaders.finish()) {
+		return EXIT_FAILURE;
 	}
-	else {
-		cout << "Texture " << teaPotTexture << " loaded successfully" << endl;
+	//Set texture as texture unit 0, the shadow map and the lightmap stay on units of their own.
+	//Programs are validated only now: before the units are set every sampler points at unit 0, which no driver accepts.
+	//Validation depends on the current GL state, so a failure is reported but not fatal
+	meshes.bind();
+	proxyProgram.validate();
+	shadowProgram.validate();
+	for (unsigned int features = 0; features < ShaderVariants::VARIANT_COUNT; features++) {
+		if (sceneShaders.isRequested(features)) {
+			const ShaderProgram& variant = sceneShaders.get(features);
+			variant.setInt(variant.uniform("uTexture"), 0);
+			variant.setInt(variant.uniform("uShadowMap"), SHADOW_TEXTURE_UNIT);
+			variant.setInt(variant.uniform("uLightmap"), LIGHTMAP_TEXTURE_UNIT);
+			variant.validate();
+		}
 	}
-	const char* plasticTexture = "Textures/black rubber.jpg";
-	if (!createTexture(plasticTexture, plasticTextureID)) {
-		cout << "Failed to load " << plasticTexture << endl;
+	glBindVertexArray(0);
+
+	//Uncapped frame rate, and every frame drawn, so each step measures the lights and nothing else
+	if (benchmarkLights) {
+		glfwSwapInterval(0);
+		onDemand = false;
+		pointLightCount = 1;
+		cout << "Light benchmark: " << lightBenchFrames << " frames per step after " << lightBenchWarmup << " warm-up frames" << endl;
 	}
-	else {
-		cout << "Texture " << plasticTexture << " loaded successfully" << endl;
+
+	//The simulation thread owns the scene and the camera from here on, the GL thread only reads the snapshots it publishes
+	if (pipelined) {
+		simulationThread = thread(simulationLoop);
 	}
-	//Tell opengl which texture unit it belongs to
-	glUseProgram(programID);
-	//Set texture as texture unit 0
-	glUniform1i(glGetUniformLocation(programID, "uTexture"), 0);
 
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f); //Background color of window is set to a solid black
 
@@ -314,17 +875,78 @@ int main(int argc, char* argv[]) {
 
 		takeInput(gWindow);
 
-		render();
+		//Nothing moved and nothing asked for a redraw: block until an event arrives instead of drawing the same frame.
+		//The sleep does not count as frame time, so a key pressed afterwards moves as far as one frame's worth
+		if (onDemand && redrawFrames == 0) {
+			unsigned int wakeups = simulationWakeups.load(memory_order_relaxed);
+			glfwWaitEventsTimeout(IDLE_TIMEOUT);
+			lastFrame = glfwGetTime();
+			//Only a wait no event cut short is checked, every requested redraw wakes the simulation thread once more
+			if (pipelined && redrawFrames == 0 && simulationWakeups.load(memory_order_relaxed) - wakeups > IDLE_WAKEUP_LIMIT) {
+				logger.log(LOG_RENDER, LOG_WARNING, "Simulation thread kept running while idle");
+			}
+			continue;
+		}
+
+		//Pipelined, this is the frame built from last iteration's input while the previous one was submitted
+		FrameSnapshot* frame = &serialFrame;
+		if (pipelined) {
+			frame = &acquireSnapshot();
+		}
+		else {
+			buildFrame(serialFrame);
+		}
+
+		render(*frame);
+		FrameStats stats = queue.getStats();
+		stats.matricesComputed = frame->matricesComputed;
+		stats.objectsCulled = frame->objectsCulled;
+		stats.lodTrianglesSaved = frame->lodTrianglesSaved;
+		stats.objectsOccluded = frame->occlusion ? occlusion.getOccluded() : 0;
+		stats.occlusionQueries = frame->occlusion ? occlusion.getQueries() : 0;
+		stats.occlusionMs = occlusionMs;
+		stats.jobThreads = jobs.getThreadCount();
+		stats.buildMs = frame->buildMs;
+		stats.snapshotWaitMs = pipelined ? snapshotWaitMs : 0.0;
+		stats.inputEvents = frame->inputEvents;
+		stats.shadowCasters = shadowCasters;
+		stats.pointLights = (unsigned int)frame->clusters.lights.size();
+		stats.clusterMs = frame->clusterMs;
+		stats.ringBytes = (unsigned int)frameRing.getUsed();
+		stats.fenceWaitMs = frameRing.getWaitMs();
+		if (shadowCasters > 0) {
+			stats.droppedFlushes += shadowQueue.getStats().droppedFlushes;
+		}
+		statsReporter.frame(stats, glfwGetTime());
+
+		//A frame that applied input or moved a node may still differ from the next one
+		if (redrawFrames > 0) {
+			redrawFrames--;
+		}
+		if (frame->inputEvents > 0 || frame->matricesComputed > 0) {
+			requestRedraw();
+		}
+
+		if (benchmarkLights && !stepLightBenchmark(*frame)) {
+			glfwSetWindowShouldClose(gWindow, true);
+		}
 
 		//Swap buffers and poll inputs
 		glfwPollEvents();
 	}
-	destroyMeshes(cylinder, Torus, plane, cube, pyramid);
-	destroyTexture(mugTextureID);
-	destroyTexture(planeTextureID);
-	destroyTexture(coverTextureID);
-	destroyShaderProgram(programID);
-	destroyShaderProgram(lightProgramID);
+	stopSimulation();
+	jobs.stop();
+	logger.stop();
+	frameRing.destroy();
+	meshes.destroy();
+	instances.destroy();
+	textureArrays.destroy();
+	occlusion.destroy();
+	sceneShaders.destroy();
+	proxyProgram.destroy();
+	shadowProgram.destroy();
+	shadowMap.destroy();
+	lightmapAtlas.destroy();
 
 	exit(EXIT_SUCCESS);
 }
@@ -347,7 +969,12 @@ bool initialize(int argc, char* argv[], GLFWwindow** window) {
 	}
 
 	glfwMakeContextCurrent(*window);
+	int width, height;
+	glfwGetFramebufferSize(*window, &width, &height);
+	framebufferWidth = width;
+	framebufferHeight = height;
 	glfwSetFramebufferSizeCallback(*window, resizeWin);
+	glfwSetWindowRefreshCallback(*window, refreshWin); //Window exposed or damaged
 	glfwSetCursorPosCallback(*window, mousePosCallback); //Get mouse position
 	glfwSetScrollCallback(*window, mouseWheelCallback); //Get scrollwheel inputs
 	glfwSetMouseButtonCallback(*window, mouseClickCallback); //Get mouse click inputs
@@ -355,6 +982,12 @@ bool initialize(int argc, char* argv[], GLFWwindow** window) {
 	//Hide mouse when program is running
 	glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
+	//Unaccelerated motion straight from the device, only available while the cursor is disabled
+	if (glfwRawMouseMotionSupported()) {
+		glfwSetInputMode(*window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
+		cout << "Raw mouse motion enabled" << endl;
+	}
+
 	glewExperimental = GL_TRUE;
 	GLenum GlewInitResult = glewInit();
 
@@ -375,69 +1008,77 @@ void takeInput(GLFWwindow* window) {
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
 		glfwSetWindowShouldClose(window, true);
 	}
-	float camOffset = moveSpeed * timePassed;
 
 	bool keyPress = false;
 
 	//Move camera forward upon pressing W
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-		cam.ProcessKeyboard(FORWARD, timePassed);
-		cout << "Input: W" << endl;
+		pushInput(INPUT_MOVE, timePassed, 0.0f, FORWARD);
+		logger.log(LOG_INPUT, LOG_INFO, "Input: W");
 		keyPress = true;
 	}
 
 	//Move camera to the left upon pressing A
 	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-		cam.ProcessKeyboard(LEFT, timePassed);;
-		cout << "Input: A" << endl;
+		pushInput(INPUT_MOVE, timePassed, 0.0f, LEFT);
+		logger.log(LOG_INPUT, LOG_INFO, "Input: A");
 		keyPress = true;
 	}
 
 	//Move camera backwards upon pressing S
 	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-		cam.ProcessKeyboard(BACKWARD, timePassed);
-		cout << "Input: S" << endl;
+		pushInput(INPUT_MOVE, timePassed, 0.0f, BACKWARD);
+		logger.log(LOG_INPUT, LOG_INFO, "Input: S");
 		keyPress = true;
 	}
 
 	//Move camera to the right upon pressing D
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-		cam.ProcessKeyboard(RIGHT, timePassed);
-		cout << "Input: D" << endl;
+		pushInput(INPUT_MOVE, timePassed, 0.0f, RIGHT);
+		logger.log(LOG_INPUT, LOG_INFO, "Input: D");
 		keyPress = true;
 	}
 
 	//Move camera upward by pressing Q
 	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) {
-		cam.ProcessKeyboard(UPWARD, timePassed);
-		cout << "Input: Q" << endl;
+		pushInput(INPUT_MOVE, timePassed, 0.0f, UPWARD);
+		logger.log(LOG_INPUT, LOG_INFO, "Input: Q");
 		keyPress = true;
 	}
 
 	//Move camera downward by pressing E
 	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) {
-		cam.ProcessKeyboard(DOWNWARD, timePassed);
-		cout << "Input: E" << endl;
+		pushInput(INPUT_MOVE, timePassed, 0.0f, DOWNWARD);
+		logger.log(LOG_INPUT, LOG_INFO, "Input: E");
 		keyPress = true;
 	}
 
 	//Every time P is pressed, one is added to int p, acting as a switch for the projection style
 	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
-		p += 1;
-		cout << "Input: P" << endl;
+		pushInput(INPUT_TOGGLE_PROJECTION, 0.0f);
+		logger.log(LOG_INPUT, LOG_INFO, "Input: P");
 		keyPress = true;
 	}
 
 
+	//O switches occlusion culling on and off, once per press
+	bool occlusionKey = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+	if (occlusionKey && !occlusionKeyDown) {
+		pushInput(INPUT_TOGGLE_OCCLUSION, 0.0f);
+		logger.log(LOG_INPUT, LOG_INFO, "Input: O");
+		keyPress = true;
+	}
+	occlusionKeyDown = occlusionKey;
+
 	//Upon pressing a key, give coordinates of cursor position at time of input
 	if (keyPress) {
 		double x, y;
 		glfwGetCursorPos(window, &x, &y);
-		cout << "Mouse coordinates: " << x << ", " << y << endl;
+		logger.log(LOG_INPUT, LOG_INFO, "Mouse coordinates: {}, {}", x, y);
 	}
 }
 
-//Calls whenever mouse moves
+//Calls whenever mouse moves, possibly hundreds of times a frame, so it only records the step
 void mousePosCallback(GLFWwindow* window, double x, double y) {
 	if (firstMouse) {
 		lastX = x;
@@ -451,20 +1092,83 @@ void mousePosCallback(GLFWwindow* window, double x, double y) {
 	lastX = x;
 	lastY = y;
 
-	cam.ProcessMouseMovement(xStep, yStep);
-	cout << "Cursor at " << x << ", " << y << endl;
+	pushInput(INPUT_LOOK, xStep, yStep);
+	logger.log(LOG_INPUT, LOG_DEBUG, "Cursor at {}, {}", x, y);
 }
 
 //Calls whenever scrollwheel is used
 void mouseWheelCallback(GLFWwindow* window, double x, double y) {
-	//Change speed
-	if (y == 1) {
-		moveSpeed += 9.0f;
+	pushInput(INPUT_SCROLL, 0.0f, (float)y);
+	logger.log(LOG_INPUT, LOG_INFO, "Scrollwheel at {}, {}", x, y);
+}
+
+//Records an event for the frame builder, a full ring drops it rather than block the GL thread
+void pushInput(InputType type, float x, float y, Camera_Movement direction) {
+	requestRedraw();
+
+	InputEvent event;
+	event.type = (unsigned char)type;
+	event.direction = (unsigned char)direction;
+	event.x = x;
+	event.y = y;
+	inputEvents.push(event);
+}
+
+unsigned int applyInput() {
+	float moveTime[DOWNWARD + 1] = {};
+	float xStep = 0.0f;
+	float yStep = 0.0f;
+	int scrollUp = 0;
+	int scrollDown = 0;
+	bool looked = false;
+	bool occlusionToggled = false;
+
+	unsigned int count = 0;
+	InputEvent event;
+	while (inputEvents.pop(event)) {
+		count++;
+		switch (event.type) {
+		case INPUT_MOVE:
+			moveTime[event.direction] += event.x;
+			break;
+		case INPUT_LOOK:
+			xStep += event.x;
+			yStep += event.y;
+			looked = true;
+			break;
+		case INPUT_SCROLL:
+			//Change speed
+			if (event.y == 1) {
+				scrollUp++;
+			}
+			else if (event.y == -1) {
+				scrollDown++;
+			}
+			break;
+		case INPUT_TOGGLE_PROJECTION:
+			p += 1;
+			break;
+		case INPUT_TOGGLE_OCCLUSION:
+			occlusionEnabled = !occlusionEnabled;
+			occlusionToggled = true;
+			break;
+		}
 	}
-	else if (y == -1) {
-		moveSpeed -= 2.0f;
+
+	//One orientation update for every cursor event of the frame, then the movement along the new axes
+	if (looked) {
+		cam.ProcessMouseMovement(xStep, yStep);
+	}
+	for (int direction = FORWARD; direction <= DOWNWARD; direction++) {
+		if (moveTime[direction] > 0.0f) {
+			cam.ProcessKeyboard((Camera_Movement)direction, moveTime[direction]);
+		}
 	}
-	cout << "Scrollwheel at " << x << ", " << y << endl;
+	moveSpeed += 9.0f * scrollUp - 2.0f * scrollDown;
+	if (occlusionToggled) {
+		logger.log(LOG_RENDER, LOG_INFO, occlusionEnabled ? "Occlusion culling on" : "Occlusion culling off");
+	}
+	return count;
 }
 
 //Calls whenever a mouse button is pressed
@@ -472,455 +1176,741 @@ void mouseClickCallback(GLFWwindow* window, int button, int input, int mods) {
 	switch (button) {
 	case GLFW_MOUSE_BUTTON_LEFT:
 		if (input == GLFW_PRESS) {
-			cout << "M1 pressed" << endl;
+			logger.log(LOG_INPUT, LOG_INFO, "M1 pressed");
 		}
 		else {
-			cout << "M1 released" << endl;
+			logger.log(LOG_INPUT, LOG_INFO, "M1 released");
 		}
 		break;
 
 	case GLFW_MOUSE_BUTTON_MIDDLE:
 		if (input == GLFW_PRESS) {
-			cout << "M3 pressed" << endl;
+			logger.log(LOG_INPUT, LOG_INFO, "M3 pressed");
 		}
 		else {
-			cout << "M3 released" << endl;
+			logger.log(LOG_INPUT, LOG_INFO, "M3 released");
 		}
 		break;
 	case GLFW_MOUSE_BUTTON_RIGHT:
 		if (input == GLFW_PRESS) {
-			cout << "M2 pressed" << endl;
+			logger.log(LOG_INPUT, LOG_INFO, "M2 pressed");
 		}
 		else {
-			cout << "M2 released" << endl;
+			logger.log(LOG_INPUT, LOG_INFO, "M2 released");
 		}
 		break;
 
 		//Default to take computer mice with more than 3 buttons into consideration
 	default:
-		cout << "Unrecognized mouse input" << endl;
+		logger.log(LOG_INPUT, LOG_WARNING, "Unrecognized mouse input");
 		break;
 	}
 }
 
 void resizeWin(GLFWwindow* window, int width, int height) {
 	glViewport(0, 0, width, height);
+	framebufferWidth = width;
+	framebufferHeight = height;
+	requestRedraw();
 }
 
-void render() {
-
-
-	//Enables z-depth
-	glEnable(GL_DEPTH_TEST);
-
-	//Clear frame and z buffers
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	//Guides camera on the z axis
-	glm::mat4 view = glm::translate(glm::vec3(0.0f, 15.0f, -30.0f));
-
-	//Camera transformation 
-	glm::mat4 pov = cam.GetViewMatrix();
-
-	//Perspective projection
-	glm::mat4 projection = glm::perspective(glm::radians(cam.Zoom), (GLfloat)winWidth / (GLfloat)winHeight, 0.1f, 100.0f);
+void refreshWin(GLFWwindow* window) {
+	requestRedraw();
+}
 
-	//Previously defined int p will determine projection style. For every time the user presses the P key, 1 is added to int p. If p is not an even number, 
-	//projection style will switch to orthographic
-	if (p % 2 != 0) {
-		projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 5.0f);
+void requestRedraw() {
+	redrawFrames = REDRAW_FRAMES;
+	//A parked simulation thread rechecks its snapshot instead of relying on the next acquire alone
+	if (pipelined) {
+		wakePipeline();
 	}
+}
 
-	//Set desired shader
-	glUseProgram(programID);
-
-	GLint lightColorLoc = glGetUniformLocation(programID, "lightColor");
-	GLint lightPositionLoc = glGetUniformLocation(programID, "lightPos");
-	glUniform3f(lightColorLoc, gLightColor.r, gLightColor.g, gLightColor.b);
-	glUniform3f(lightPositionLoc, gLightPos.x, gLightPos.y, gLightPos.z);
-
-	//Pass previously defined matrices to shader
-	GLint modelLocation = glGetUniformLocation(programID, "model");
-	GLint viewLocation = glGetUniformLocation(programID, "view");
-	GLint projLocation = glGetUniformLocation(programID, "projection");
-
-	glUniformMatrix4fv(viewLocation, 1, GL_FALSE, glm::value_ptr(pov));
-	glUniformMatrix4fv(projLocation, 1, GL_FALSE, glm::value_ptr(projection));
-
-	GLint UVScaleLoc = glGetUniformLocation(programID, "uvScale");
-	glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-	//Model matrix for mug base
-	glm::mat4 scaleCylinder = glm::scale(glm::vec3(3.0f, 3.0f, 3.5f));
-	glm::mat4 rotateCylinder = glm::rotate(-30.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4 translateCylinder = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-	glm::mat4 modelCylinder = translateCylinder * rotateCylinder * scaleCylinder;
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelCylinder));
-
-	//Activate VBOs for mug base
-	glBindVertexArray(cylinder.vao);
-
-	//Bind textures on mug base
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, mugTextureID);
-
-	//Draw triangles that make up mug base
-	glDrawElements(GL_TRIANGLES, cylinder.nIndices, GL_UNSIGNED_SHORT, NULL);
-
-	//Deactivate VAO and texture for mug base
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	//Model matrix for mug handle
-	glm::mat4 scaleTorus = glm::scale(glm::vec3(1.0f, 1.0f, 2.0f)); //Set z axis to 2 to give more of a curved shape for the handle for the perspective given
-	glm::mat4 rotateTorus = glm::rotate(100.5f, glm::vec3(1.0f, 0.0f, 0.0f)); //Rotate torus along x axis
-	glm::mat4 translateTorus = glm::translate(glm::vec3(1.0f, 0.0f, 0.0f)); //Set Torus slightly towards right of origin so half of it clips into cylinder (Illusion of handle in mug)
-	glm::mat4 modelTorus = translateTorus * rotateTorus * scaleTorus;
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelTorus));
-
-	//Activate VBOs for mug handle
-	glBindVertexArray(Torus.vao);
+//Camera and mode state the frame is built from, copied from the GL thread's input handling
+ViewInput readViewInput() {
+	ViewInput input;
+	input.position = cam.Position;
+	input.view = cam.GetViewMatrix();
+	input.zoom = cam.Zoom;
+	input.orthographic = p % 2 != 0; //Every odd press of P switches to orthographic
+	input.occlusion = occlusionEnabled;
+	input.framebufferWidth = framebufferWidth;
+	input.framebufferHeight = framebufferHeight;
+	return input;
+}
 
-	//Bind textures on mug handle
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, mugTextureID);
+//Wakes whichever thread sleeps on the pipeline. Passing through the lock orders the change the sleeper waits for
+//before its next check, so a wake that arrives between its check and its sleep is not lost
+void wakePipeline() {
+	{
+		lock_guard<mutex> lock(pipelineWakeMutex);
+	}
+	pipelineWake.notify_all();
+}
 
-	//Draw triangles that make up mug handle
-	glDrawElements(GL_TRIANGLES, Torus.nIndices, GL_UNSIGNED_SHORT, NULL);
+//Simulation thread: builds a frame from the latest input, publishes it, then sleeps until the GL thread
+//has taken it before starting the next one, so it never runs more than one frame ahead
+void simulationLoop() {
+	while (!simulationStopping.load(memory_order_relaxed)) {
+		buildFrame(snapshots.writeBuffer());
+		snapshots.publish();
+		wakePipeline();
+
+		unique_lock<mutex> lock(pipelineWakeMutex);
+		pipelineWake.wait(lock, [] {
+			simulationWakeups.fetch_add(1, memory_order_relaxed);
+			return snapshots.taken() || simulationStopping.load(memory_order_relaxed);
+		});
+	}
+}
 
-	//Deactivate VAO for mug handle
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+//GL thread: takes over the newest snapshot, sleeping first when the simulation thread is still building it
+FrameSnapshot& acquireSnapshot() {
+	double waitStart = glfwGetTime();
+	if (!snapshots.acquire()) {
+		unique_lock<mutex> lock(pipelineWakeMutex);
+		pipelineWake.wait(lock, [] { return snapshots.acquire(); });
+	}
+	wakePipeline();
+	snapshotWaitMs = (glfwGetTime() - waitStart) * 1000.0;
+	return snapshots.readBuffer();
+}
 
-	//Model matrix for plane  (Countertop)
-	glm::mat4 scalePlane = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
-	glm::mat4 rotatePlane = glm::rotate(100.5f, glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4 translatePlane = glm::translate(glm::vec3(0.0f, 3.94f, -1.0f));
-	glm::mat4 modelPlane = scalePlane * rotatePlane * translatePlane;
+void stopSimulation() {
+	if (!simulationThread.joinable()) {
+		return;
+	}
+	simulationStopping.store(true, memory_order_relaxed);
+	wakePipeline();
+	simulationThread.join();
+}
 
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelPlane));
+//Everything about a frame that needs no GL: input, scene update, culling, level of detail and the sorted draw list
+void buildFrame(FrameSnapshot& frame) {
+	double buildStart = glfwGetTime();
+	frame.inputEvents = applyInput();
+	ViewInput input = readViewInput();
 
-	//Activate VBOs for plane
-	glBindVertexArray(plane.vao);
+	//Perspective projection
+	glm::mat4 projection = glm::perspective(glm::radians(input.zoom), (GLfloat)winWidth / (GLfloat)winHeight, clusterNear, perspectiveFar);
+	float farPlane = perspectiveFar;
+	lodSelector.setPerspective((GLfloat)input.framebufferHeight, glm::radians(input.zoom));
+	if (input.orthographic) {
+		projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, clusterNear, orthographicFar);
+		farPlane = orthographicFar;
+		lodSelector.setOrthographic((GLfloat)input.framebufferHeight, 10.0f);
+	}
 
-	//Bind textures on plane
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, planeTextureID);
+	//Both programs read camera and light values from one uniform buffer, written once per frame
+	frame.uniforms.view = input.view;
+	frame.uniforms.projection = projection;
+	frame.uniforms.viewPosition = glm::vec4(input.position, 1.0f);
+	frame.uniforms.lightPosition = glm::vec4(gLightPos, 1.0f);
+	frame.uniforms.lightColor = glm::vec4(gLightColor, 1.0f);
+	frame.uniforms.uvScale = gUVScale;
+	frame.uniforms.ambientStrength = gAmbientStrength;
+	frame.occlusion = input.occlusion;
+
+	//Only nodes that changed since last frame get a new world matrix, a static desk computes none
+	scene.update();
+	frame.matricesComputed = scene.getLastUpdateCount();
+
+	//Objects whose node moved get new world bounds, the rest keep last frame's.
+	//Every object only writes its own entries, so the threads never touch the same data
+	bool useBvh = sceneObjects.size() >= bvhObjectThreshold;
+	unsigned int objectCount = (unsigned int)sceneObjects.size();
+	for (std::size_t t = 0; t < frameWork.size(); t++) {
+		frameWork[t].boundsChanged = false;
+	}
+	jobs.parallelFor(objectCount, jobGrain, [useBvh](unsigned int begin, unsigned int end, unsigned int thread) {
+		for (unsigned int i = begin; i < end; i++) {
+			const SceneObject& object = sceneObjects[i];
+			if (scene.wasUpdated(object.node)) {
+				const MeshBounds& bounds = meshes.getBounds(object.mesh);
+				const glm::mat4& model = scene.getWorld(object.node);
+				objectBounds[i] = transformAabb(model, bounds.min, bounds.max);
+
+				transformSphere(model, bounds.center, bounds.radius, objectCenters[i], objectRadii[i]);
+				objectScales[i] = bounds.radius > 0.0f ? objectRadii[i] / bounds.radius : 1.0f;
+				if (!useBvh) {
+					cullingTable.set(i, objectCenters[i], objectRadii[i]);
+				}
+				frameWork[thread].boundsChanged = true;
+			}
+		}
+	});
+	bool boundsChanged = false;
+	for (std::size_t t = 0; t < frameWork.size(); t++) {
+		boundsChanged = boundsChanged || frameWork[t].boundsChanged;
+	}
 
-	// Draw the triangles that make up the plane
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+	//Built once, afterwards moved objects only stretch the boxes above them
+	if (useBvh) {
+		if (bvh.empty()) {
+			bvh.build(objectBounds);
+		}
+		else if (boundsChanged) {
+			bvh.refit(objectBounds);
+		}
+	}
 
-	//Deactivate VAO for plane
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	//Baked lighting already holds the light's shadows
+	if (!lightmapsEnabled) {
+		buildShadowCasters(frame, boundsChanged);
+	}
+	frame.uniforms.lightSpace = shadowLightSpace;
 
-	//Model matrix for plane (Notebook top cover)
-	glm::mat4 scaleCover = glm::scale(glm::vec3(.23f, .25f, .25f));
-	glm::mat4 rotateCover = glm::rotate(98.85f, glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4 translateCover = glm::translate(glm::vec3(14.0f, 2.0f, 11.0f));
-	glm::mat4 modelCover = scaleCover * rotateCover * translateCover;
+	//Lights are laid out over the scene's current bounds whenever the requested count changes
+	double clusterStart = glfwGetTime();
+	unsigned int lightCount = pointLightCount;
+	if (lightCount != placedLights) {
+		placePointLights(lightCount);
+	}
+	lightClusters.build(input.view, projection, clusterNear, farPlane, frame.clusters);
+	frame.uniforms.clusterParams = glm::vec4((float)input.framebufferWidth / LightClusters::TILES_X, (float)input.framebufferHeight / LightClusters::TILES_Y,
+		LightClusters::sliceScale(clusterNear, farPlane), clusterNear);
+	frame.clusterMs = (glfwGetTime() - clusterStart) * 1000.0;
+
+	//Each thread culls its share of the scene and turns the survivors into draw packets in a list of its own.
+	//The BVH is split into subtrees, the table into runs of objects tested several at a time
+	Frustum frustum = extractFrustum(projection * input.view);
+	for (std::size_t t = 0; t < frameWork.size(); t++) {
+		frameWork[t].visible.clear();
+		frameWork[t].occlusionTested.clear();
+		frameWork[t].trianglesSaved = 0;
+		threadLists[t].clear();
+	}
+	if (useBvh) {
+		bvh.getSubtreeRoots(jobs.getThreadCount() * 4, subtreeRoots);
+		jobs.parallelFor((unsigned int)subtreeRoots.size(), 1, [&frustum, &input](unsigned int begin, unsigned int end, unsigned int thread) {
+			for (unsigned int r = begin; r < end; r++) {
+				std::size_t firstVisible = frameWork[thread].visible.size();
+				bvh.cullSubtree(frustum, subtreeRoots[r], frameWork[thread].visible);
+				buildPackets(frameWork[thread], threadLists[thread], firstVisible, input);
+			}
+		});
+	}
+	else {
+		jobs.parallelFor(objectCount, jobGrain, [&frustum, &input](unsigned int begin, unsigned int end, unsigned int thread) {
+			std::size_t firstVisible = frameWork[thread].visible.size();
+			cullingTable.cullRange(frustum, begin, end, frameWork[thread].visible);
+			buildPackets(frameWork[thread], threadLists[thread], firstVisible, input);
+		});
+	}
 
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelCover));
+	//Each list is sorted on a worker, then the sorted runs are merged into the frame's draw list
+	jobs.parallelFor((unsigned int)threadLists.size(), 1, [](unsigned int begin, unsigned int end, unsigned int) {
+		for (unsigned int t = begin; t < end; t++) {
+			RenderQueue::sortList(threadLists[t]);
+		}
+	});
+	RenderQueue::mergeLists(threadLists, frame.items);
+
+	//The GL thread draws the proxies after this frame is rebuilt, so the tested boxes travel with the frame
+	unsigned int visibleCount = 0;
+	frame.occlusionTested.clear();
+	frame.occlusionBoxes.clear();
+	frame.lodTrianglesSaved = 0;
+	for (std::size_t t = 0; t < frameWork.size(); t++) {
+		visibleCount += (unsigned int)frameWork[t].visible.size();
+		frame.occlusionTested.insert(frame.occlusionTested.end(), frameWork[t].occlusionTested.begin(), frameWork[t].occlusionTested.end());
+		frame.lodTrianglesSaved += frameWork[t].trianglesSaved;
+	}
+	for (std::size_t i = 0; i < frame.occlusionTested.size(); i++) {
+		frame.occlusionBoxes.push_back(objectBounds[frame.occlusionTested[i]]);
+	}
+	frame.objectsCulled = objectCount - visibleCount;
+	frame.buildMs = (glfwGetTime() - buildStart) * 1000.0;
+}
 
-	glBindVertexArray(plane.vao);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, coverTextureID);
+//Submits a built frame, the only place GL is called from each frame
+void render(FrameSnapshot& frame) {
+	//Take over the oldest section of the ring, normally the GPU finished with it frames ago
+	frameRing.beginFrame();
 
-	//Draw top cover
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glBindVertexArray(0);
+	//Enables z-depth
+	glEnable(GL_DEPTH_TEST);
 
-	//Model matrix for plane(Notebook bottom cover)
-	glm::mat4 translateTopCover = glm::translate(glm::vec3(14.0f, 1.f, 11.0f));
-	glm::mat4 modelTopCover = scaleCover * rotateCover * translateTopCover;
+	//Without room in the ring this frame goes without point lights, a zero tile width tells the shader to skip them
+	if (!lightClusterBuffer.upload(frameRing, frame.clusters)) {
+		frame.uniforms.clusterParams.x = 0.0f;
+	}
+	frameUniformBuffer.update(frameRing, frame.uniforms);
+
+	//Most frames carry no casters and sample the map left by an earlier frame
+	shadowCasters = (unsigned int)frame.shadowCasters.size();
+	if (shadowCasters > 0) {
+		int width, height;
+		glfwGetFramebufferSize(gWindow, &width, &height);
+		shadowMap.begin();
+		shadowQueue.takeSorted(frame.shadowCasters);
+		shadowQueue.flush(meshes, instances, frameRing);
+		shadowMap.end(width, height);
+	}
 
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelTopCover));
+	//Clear frame and z buffers
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glBindVertexArray(plane.vao);
+	//Last frame's occlusion results are collected without waiting, the ones still in flight are ignored.
+	//Small lit objects are drawn only if last frame's query saw them
+	double occlusionStart = glfwGetTime();
+	if (frame.occlusion) {
+		occlusion.beginFrame();
+	}
+	for (std::size_t i = 0; i < frame.items.size(); i++) {
+		RenderItem& item = frame.items[i];
+		item.condition = frame.occlusion && item.occludee != NO_OCCLUDEE ? occlusion.conditionFor(item.occludee) : 0;
+	}
+	occlusionMs = (glfwGetTime() - occlusionStart) * 1000.0;
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	//The draw list arrives sorted by program, texture array and mesh, drawn front to back through the indirect command buffer
+	queue.takeSorted(frame.items);
+	queue.flush(meshes, instances, frameRing);
 
-	//Model matrix for cube (Paper)
-	glm::mat4 scaleCube = glm::scale(glm::vec3(3.8f, 0.2f, 5.f));
-	glm::mat4 rotateCube = glm::rotate(-0.1f, glm::vec3(.0f, 1.0f, .0f));
-	glm::mat4 translateCube = glm::translate(glm::vec3(-3.f, -0.87f, 3.2f));
-	//translate * rotate * scale
-	glm::mat4 modelPaperCube = translateCube * rotateCube * scaleCube;
+	//With the scene's depth in place, test the small objects for next frame
+	occlusionStart = glfwGetTime();
+	occlusion.drawProxies(frame.occlusionTested, frame.occlusionBoxes, meshes, glm::vec3(frame.uniforms.viewPosition));
+	occlusionMs += (glfwGetTime() - occlusionStart) * 1000.0;
 
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelPaperCube));
+	//Nothing after this reads the section, so its fence tells the frame that reuses it when that is safe
+	frameRing.endFrame();
 
-	glBindVertexArray(cube.vao);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, paperTextureID);
+	glfwSwapBuffers(gWindow);
+}
 
-	glDrawArrays(GL_TRIANGLES, 0, cube.numVertices);
+//Turns work.visible from firstVisible on into render items. Every visible object is drawn through the render queue,
+//which sorts by state and sends each texture array's draws as one multi-draw.
+//Small lit objects are marked for occlusion testing, the GL thread turns that into last frame's query
+void buildPackets(FrameWork& work, RenderList& list, std::size_t firstVisible, const ViewInput& input) {
+	for (std::size_t i = firstVisible; i < work.visible.size(); i++) {
+		unsigned int index = work.visible[i];
+		SceneObject& object = sceneObjects[index];
+		const glm::mat4& model = scene.getWorld(object.node);
+
+		//Parametric shapes drop to the coarsest level whose error still fits under the pixel threshold,
+		//measured from the nearest point of the object's bounding sphere. Lightmapped objects keep the level they were
+		//baked on, the other levels' triangles have no cells in the atlas
+		MeshHandle mesh = object.mesh;
+		if (object.lodChain != NO_LOD_CHAIN && object.lightmap == 0) {
+			const LodChain& chain = sceneLods[object.lodChain];
+			float distance = glm::length(objectCenters[index] - input.position) - objectRadii[index];
+			object.lodLevel = lodSelector.select(chain, objectScales[index], distance, object.lodLevel);
+			mesh = chain.meshes[object.lodLevel];
+			work.trianglesSaved += chain.triangles[0] - chain.triangles[object.lodLevel];
+		}
 
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	//Model matrix for notebook rings (Toruses)
-	GLfloat j = 0.7f;
-	GLfloat k = -4.7f;
-	for (int i = 0; i < 16; i++) {
-		glm::mat4 scaleRing = glm::scale(glm::vec3(.2f, .2f, .4f));
-		glm::mat4 rotateRing = glm::rotate(-0.1f, glm::vec3(.0f, 1.0f, .0f));
-		glm::mat4 translateRing = glm::translate(glm::vec3(k, -0.87f, j));
-		j += 0.3f;
-		k -= 0.025f;
-		glm::mat4 modelRing = translateRing * rotateRing * scaleRing;
-		glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelRing));
-		glBindVertexArray(Torus.vao);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, mugTextureID);
-		glDrawElements(GL_TRIANGLES, Torus.nIndices, GL_UNSIGNED_SHORT, NULL);
-		//Texture for mug handle will work for notebook rings as well
+		list.push_back(queue.makeItem(object.program, mesh, object.texture, model, scene.getNormal(object.node), viewDepth(input.view, model)));
+		list.back().lightmap = object.lightmap;
+		if (input.occlusion && (object.features & SHADER_LIT) != 0 && objectRadii[index] < occludeeRadius) {
+			list.back().occludee = index;
+			work.occlusionTested.push_back(index);
+		}
 	}
+}
 
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	//Model matrix for pencil (Uses same cylinder as Cylinder)
-	glm::mat4 scalePencil = glm::scale(glm::vec3(.2f, 2.f, .2f));
-	glm::mat4 rotatePencil = glm::rotate(1.7f, glm::vec3(0.f, .35f, 1.f));
-	glm::mat4 translatePencil = glm::translate(glm::vec3(-3.5f, -1.f, 6.2f));
-	glm::mat4 modelPencil = translatePencil * rotatePencil * scalePencil;
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelPencil));
-	glBindVertexArray(cylinder.vao);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, pencilTextureID);
-	glDrawElements(GL_TRIANGLES, cylinder.nIndices, GL_UNSIGNED_SHORT, NULL);
-
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	//Model matrix for pencil tip (pyramid)
-	glm::mat4 scaleTip = glm::scale(glm::vec3(.043f, .043f, .043f));
-	glm::mat4 rotateTip = glm::rotate(1.85f, glm::vec3(0.f, .35f, 1.f));
-	glm::mat4 translateTip = glm::translate(glm::vec3(-4.19f, -1.01f, 6.46f));
-	glm::mat4 modelTip = translateTip * rotateTip * scaleTip;
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelTip));
-	glBindVertexArray(pyramid.vao);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, pencilTipTextureID);
-	glDrawArrays(GL_TRIANGLES, 0, pyramid.numVertices);
-
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	//Model matrix for eraser (sphere)
-	glm::mat4 scaleEraser = glm::scale(glm::vec3(.07f, .07f, .07f));
-	glm::mat4 rotateEraser = glm::rotate(0.1f, glm::vec3(.01f, .01f, .01f));
-	glm::mat4 translateEraser = glm::translate(glm::vec3(-2.8f, -1.f, 5.94f));
-	glm::mat4 modelEraser = translateEraser * rotateEraser * scaleEraser;
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelEraser));
-
-	glGenVertexArrays(1, &sphereVaoID);
-	glBindVertexArray(sphereVaoID);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, eraserTextureID);
-	glGenBuffers(1, &sphereVboID);
-	glBindBuffer(GL_ARRAY_BUFFER, sphereVboID);        
-	glBufferData(GL_ARRAY_BUFFER,            
-		sphere.getInterleavedVertexSize(),
-		sphere.getInterleavedVertices(),  
-		GL_STATIC_DRAW);                  
-
-	glGenBuffers(1, &sphereIboID);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereIboID);   
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER,        
-		sphere.getIndexSize(),        
-		sphere.getIndices(),           
-		GL_STATIC_DRAW);    
-
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glEnableVertexAttribArray(2);
-
-	int stride = sphere.getInterleavedStride();  
-	glVertexAttribPointer(0, 3, GL_FLOAT, false, stride, (void*)0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, false, stride, (void*)(sizeof(float) * 3));
-	glVertexAttribPointer(2, 2, GL_FLOAT, false, stride, (void*)(sizeof(float) * 6));
-
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-	glBindVertexArray(sphereVaoID);
-	glDrawElements(GL_TRIANGLES,           
-		sphere.getIndexCount(),        
-		GL_UNSIGNED_INT,                 
-		(void*)0);                 
+//Fills frame.shadowCasters with every lit object when the light or an object moved since the map was drawn.
+//Casters are not culled against the camera, an object behind it can still throw a shadow into view
+void buildShadowCasters(FrameSnapshot& frame, bool boundsChanged) {
+	frame.shadowCasters.clear();
+	if (shadowCached && !boundsChanged && shadowLight == gLightPos) {
+		return;
+	}
+	shadowCached = true;
+	shadowLight = gLightPos;
+
+	//The light's frustum is fitted to the casters' boxes as the light sees them
+	shadowCorners.clear();
+	for (std::size_t i = 0; i < sceneObjects.size(); i++) {
+		if ((sceneObjects[i].features & SHADER_LIT) == 0) {
+			continue;
+		}
+		const Aabb& box = objectBounds[i];
+		for (int corner = 0; corner < 8; corner++) {
+			shadowCorners.push_back(glm::vec3(corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y, corner & 4 ? box.max.z : box.min.z));
+		}
+	}
+	if (shadowCorners.empty()) {
+		return;
+	}
+	shadowLightSpace = lightViewProjection(shadowLight, shadowCorners);
 
-	// unbind VAO
-	glBindVertexArray(0);
+	//Depth only, so every caster uses its finest mesh and the sort key only groups by mesh
+	for (std::size_t t = 0; t < threadLists.size(); t++) {
+		threadLists[t].clear();
+	}
+	jobs.parallelFor((unsigned int)sceneObjects.size(), jobGrain, [](unsigned int begin, unsigned int end, unsigned int thread) {
+		for (unsigned int i = begin; i < end; i++) {
+			const SceneObject& object = sceneObjects[i];
+			if ((object.features & SHADER_LIT) != 0) {
+				threadLists[thread].push_back(shadowQueue.makeItem(shadowSlot, object.mesh, shadowTextureSlot, scene.getWorld(object.node),
+					scene.getNormal(object.node), 0.0f));
+			}
+		}
+	});
+	jobs.parallelFor((unsigned int)threadLists.size(), 1, [](unsigned int begin, unsigned int end, unsigned int) {
+		for (unsigned int t = begin; t < end; t++) {
+			RenderQueue::sortList(threadLists[t]);
+		}
+	});
+	RenderQueue::mergeLists(threadLists, frame.shadowCasters);
+}
 
-	//Model matrix for tea pot base(sphere)
-	glm::mat4 scalePotBase = glm::scale(glm::vec3(2.5f, 2.5f, 2.5f));
-	glm::mat4 rotatePotBase = glm::rotate(0.18f, glm::vec3(0.f, 1.0f, .0f));
-	glm::mat4 translatePotBase = glm::translate(glm::vec3(4.5f, -1.1f, -2.f));
-	glm::mat4 modelPotBase = translatePotBase * rotatePotBase * scalePotBase;
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelPotBase));
-
-	glGenVertexArrays(1, &sphereVaoID);
-	glBindVertexArray(sphereVaoID);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, teaPotTextureID);
-	glGenBuffers(1, &sphereVboID);
-	glBindBuffer(GL_ARRAY_BUFFER, sphereVboID);          
-	glBufferData(GL_ARRAY_BUFFER,              
-		sphere.getInterleavedVertexSize(),
-		sphere.getInterleavedVertices(),  
-		GL_STATIC_DRAW);                  
-
-	glGenBuffers(1, &sphereIboID);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereIboID);   
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER,         
-		sphere.getIndexSize(),            
-		sphere.getIndices(),        
-		GL_STATIC_DRAW); 
-
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glEnableVertexAttribArray(2);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, false, stride, (void*)0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, false, stride, (void*)(sizeof(float) * 3));
-	glVertexAttribPointer(2, 2, GL_FLOAT, false, stride, (void*)(sizeof(float) * 6));
+//Bakes every lit object into one atlas on the job threads and uploads it. Without --lightmap, or when the bake fails,
+//the atlas stays empty and every object is lit at runtime
+void bakeLightmaps() {
+	LightmapBaker baker;
+	if (lightmapsEnabled) {
+		//World matrices are composed here, the graph's first update() must still see every node as moved
+		for (std::size_t i = 0; i < sceneObjects.size(); i++) {
+			SceneObject& object = sceneObjects[i];
+			if ((object.features & SHADER_LIT) == 0) {
+				continue;
+			}
+			glm::mat4 model = composeTransform(scene.getTransform(object.node));
+			for (NodeHandle parent = scene.getParent(object.node); parent != ROOT_NODE; parent = scene.getParent(parent)) {
+				model = composeTransform(scene.getTransform(parent)) * model;
+			}
+			object.lightmap = baker.addObject(meshes.getGeometry(object.mesh), model);
+		}
 
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		//Same light, ambient strength and falloff-free diffuse as the lit fragment shader
+		LightmapSettings settings;
+		settings.lightPosition = gLightPos;
+		settings.lightColor = gLightColor;
+		settings.ambient = gAmbientStrength;
+		settings.albedo = 0.5f;
+		settings.bounces = 2;
+		settings.samples = 32;
+		settings.texelsPerUnit = 32.0f;
+
+		double bakeStart = glfwGetTime();
+		if (baker.bake(jobs, settings)) {
+			cout << "Lightmap baked in " << (glfwGetTime() - bakeStart) * 1000.0 << " ms" << endl;
+		}
+		else {
+			cout << "Lightmap bake failed, lighting every object at runtime" << endl;
+			lightmapsEnabled = false;
+			for (std::size_t i = 0; i < sceneObjects.size(); i++) {
+				SceneObject& object = sceneObjects[i];
+				object.lightmap = 0;
+				if ((object.features & SHADER_LIGHTMAPPED) != 0) {
+					object.features = litFeatures(object.texture, false);
+					object.program = variantSlot(object.features);
+				}
+			}
+		}
+	}
+	lightmapAtlas.create(lightmapsEnabled ? &baker : NULL);
+}
 
-	glBindVertexArray(sphereVaoID);
-	glDrawElements(GL_TRIANGLES,                 
-		sphere.getIndexCount(),         
-		GL_UNSIGNED_INT,                 
-		(void*)0);                   
+Aabb litObjectBounds() {
+	Aabb bounds;
+	bounds.min = glm::vec3(FLT_MAX);
+	bounds.max = glm::vec3(-FLT_MAX);
+	for (std::size_t i = 0; i < sceneObjects.size(); i++) {
+		if ((sceneObjects[i].features & SHADER_LIT) != 0) {
+			bounds.min = glm::min(bounds.min, objectBounds[i].min);
+			bounds.max = glm::max(bounds.max, objectBounds[i].max);
+		}
+	}
+	return bounds;
+}
 
-	// unbind VAO
-	glBindVertexArray(0);
+//Spreads count lights over the scene in a sunflower spiral, at varying heights above its floor.
+//Each light reaches about twice the spacing between lights, so a point is lit by a handful of them at any count
+void placePointLights(unsigned int count) {
+	placedLights = count;
+	vector<PointLight> lights;
+	Aabb bounds = litObjectBounds();
+	if (count == 0 || bounds.min.x > bounds.max.x) {
+		lightClusters.setLights(lights);
+		return;
+	}
 
-	//Model matrix for tea pot lid handle(sphere)
-	glm::mat4 scaleHandle = glm::scale(glm::vec3(.3f, .3f, .3f));
-	glm::mat4 rotateHandle = glm::rotate(0.18f, glm::vec3(0.f, 1.0f, .0f));
-	glm::mat4 translateHandle = glm::translate(glm::vec3(4.5f, 1.6f, -2.f));
-	glm::mat4 modelHandle = translateHandle * rotateHandle * scaleHandle;
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelHandle));
-
-	glGenVertexArrays(1, &sphereVaoID);
-	glBindVertexArray(sphereVaoID);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, plasticTextureID);
-	glGenBuffers(1, &sphereVboID);
-	glBindBuffer(GL_ARRAY_BUFFER, sphereVboID);         
-	glBufferData(GL_ARRAY_BUFFER,                
-		sphere.getInterleavedVertexSize(), 
-		sphere.getInterleavedVertices(),   
-		GL_STATIC_DRAW);                   
-
-	glGenBuffers(1, &sphereIboID);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereIboID);   
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, 
-		sphere.getIndexSize(),
-		sphere.getIndices(), 
-		GL_STATIC_DRAW);          
-
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glEnableVertexAttribArray(2);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, false, stride, (void*)0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, false, stride, (void*)(sizeof(float) * 3));
-	glVertexAttribPointer(2, 2, GL_FLOAT, false, stride, (void*)(sizeof(float) * 6));
+	glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+	glm::vec3 extent = bounds.max - center;
+	float spread = max(extent.x, extent.z);
+	float reach = glm::clamp(2.0f * spread * sqrt(glm::pi<float>() / count), 0.5f, spread);
+	const float goldenAngle = 2.39996323f;
+	for (unsigned int i = 0; i < count; i++) {
+		float along = sqrt((i + 0.5f) / count);
+		float angle = i * goldenAngle;
+		float lift = (i * 0.618034f) - floor(i * 0.618034f);
+
+		PointLight light;
+		light.positionRadius = glm::vec4(center.x + spread * along * cos(angle), bounds.min.y + extent.y * 2.0f * (0.2f + 0.8f * lift),
+			center.z + spread * along * sin(angle), reach);
+
+		//Hue around the color wheel
+		float hue = lift * 6.0f;
+		light.color = 0.5f * glm::vec4(glm::clamp(fabs(hue - 3.0f) - 1.0f, 0.0f, 1.0f), glm::clamp(2.0f - fabs(hue - 2.0f), 0.0f, 1.0f),
+			glm::clamp(2.0f - fabs(hue - 4.0f), 0.0f, 1.0f), 1.0f);
+		lights.push_back(light);
+	}
+	lightClusters.setLights(lights);
+}
 
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+bool stepLightBenchmark(const FrameSnapshot& frame) {
+	//The count changes on the GL thread, so the warm-up also covers the frames already built with the old one
+	lightBenchFrame++;
+	if (lightBenchFrame <= lightBenchWarmup) {
+		lightBenchStart = glfwGetTime();
+		return true;
+	}
+	lightBenchClusterMs += frame.clusterMs;
+	lightBenchVisible += (unsigned int)frame.clusters.lights.size();
+	lightBenchEntries += (unsigned int)frame.clusters.indices.size();
+	if (lightBenchFrame < lightBenchWarmup + lightBenchFrames) {
+		return true;
+	}
 
-	glBindVertexArray(sphereVaoID);
-	glDrawElements(GL_TRIANGLES,           
-		sphere.getIndexCount(),         
-		GL_UNSIGNED_INT,               
-		(void*)0);                     
+	unsigned int lights = pointLightCount;
+	double frameMs = (glfwGetTime() - lightBenchStart) * 1000.0 / lightBenchFrames;
+	cout << "Lights " << lights << ": " << frameMs << " ms per frame, " << lightBenchClusterMs / lightBenchFrames << " ms to cluster, "
+		<< lightBenchVisible / lightBenchFrames << " visible, " << lightBenchEntries / lightBenchFrames << " cluster entries" << endl;
 
-	// unbind VAO
-	glBindVertexArray(0);
+	lightBenchFrame = 0;
+	lightBenchClusterMs = 0.0;
+	lightBenchVisible = 0;
+	lightBenchEntries = 0;
+	if (lights >= LightClusters::MAX_LIGHTS) {
+		return false;
+	}
+	pointLightCount = lights * 2;
+	return true;
+}
 
+ProgramSlot variantSlot(unsigned int features) {
+	if (!sceneShaders.isRequested(features)) {
+		variantSlots[features] = queue.addProgram(sceneShaders.request(features));
+	}
+	return variantSlots[features];
+}
 
-	//Model matrix for tea pot handle
-	glm::mat4 scalePotHandle = glm::scale(glm::vec3(2.0f, 2.0f, 3.0f)); //Set z axis to 2 to give more of a curved shape for the handle for the perspective given
-	glm::mat4 rotatePotHandle = glm::rotate(100.55f, glm::vec3(1.0f, 0.0f, 0.0f)); //Rotate torus along x axis
-	glm::mat4 translatePotHandle = glm::translate(glm::vec3(4.4f, 1.0f, -2.f)); //Set Torus slightly towards right of origin so half of it clips into cylinder (Illusion of handle in mug)
-	glm::mat4 modelPotHandle = translatePotHandle * rotatePotHandle * scalePotHandle;
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelPotHandle));
+//Cheapest variant that draws a lit material: untextured objects skip sampling, baked objects read the lightmap
+//instead of the shadow map
+unsigned int litFeatures(TextureSlot texture, bool lightmapped) {
+	unsigned int features = SHADER_LIT | SHADER_SPECULAR | (lightmapped ? SHADER_LIGHTMAPPED : SHADER_SHADOWED);
+	if (texture != noTextureSlot) {
+		features |= SHADER_TEXTURED;
+	}
+	return features;
+}
 
-	//Activate VBOs for mug handle
-	glBindVertexArray(Torus.vao);
+//Adds a drawable node to the scene
+NodeHandle addSceneObject(const Transform& local, NodeHandle parent, MeshHandle mesh, TextureSlot texture, unsigned int features) {
+	SceneObject object;
+	object.node = scene.addNode(local, parent);
+	object.mesh = mesh;
+	object.features = features;
+	object.program = variantSlot(features);
+	object.texture = texture;
+	object.lodChain = NO_LOD_CHAIN;
+	object.lodLevel = 0;
+	object.lightmap = 0;
+	sceneObjects.push_back(object);
+	return object.node;
+}
 
-	//Bind textures on mug handle
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, plasticTextureID);
+//Registers one level of a chain, its triangle count comes from the registered index range
+void addLodLevel(LodChain& chain, MeshHandle mesh, float error) {
+	chain.add(mesh, error, meshes.getRange(mesh).indexCount / 3);
+}
 
-	//Draw triangles that make up mug handle
-	glDrawElements(GL_TRIANGLES, Torus.nIndices, GL_UNSIGNED_SHORT, NULL);
+//Each level has a quarter of the previous level's segments, down to 8
+void buildCylinderLods(LodChain& chain, int numSegments) {
+	int segments = numSegments;
+	while (true) {
+		MeshData mesh;
+		buildCylinder(mesh, segments);
+		addLodLevel(chain, meshes.add(mesh), chordError(cylinderRadius, segments));
+
+		int next = std::max(segments / 4, std::min(segments, 8));
+		if (next == segments) {
+			break;
+		}
+		segments = next;
+	}
+}
 
-	//Deactivate VAO for mug handle
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+//Each level halves the slices around the handle, down to 12, and drops a third of the segments around the tube, down to 4
+void buildTorusLods(LodChain& chain, int numSegments, int numSlices) {
+	int segments = numSegments;
+	int slices = numSlices;
+	while (true) {
+		MeshData mesh;
+		buildTorus(mesh, segments, slices);
+
+		//The tube and the ring both cut corners, at worst in the same place
+		float error = chordError(torusInRadius, segments) + chordError(torusOutRadius + torusInRadius, slices);
+		addLodLevel(chain, meshes.add(mesh), error);
+
+		int nextSegments = std::max(segments * 2 / 3, std::min(segments, 4));
+		int nextSlices = std::max(slices / 2, std::min(slices, 12));
+		if (nextSegments == segments && nextSlices == slices) {
+			break;
+		}
+		segments = nextSegments;
+		slices = nextSlices;
+	}
+}
 
-	//Model matrix for tea pot spout
-	glm::mat4 scaleSpout = glm::scale(glm::vec3(1.f, 1.f, 1.f));
-	glm::mat4 rotateSpout = glm::rotate(3.7f, glm::vec3(.0f, .0f, 1.0f));
-	glm::mat4 translateSpout = glm::translate(glm::vec3(2.2f, 0.f, -2.f));
-	glm::mat4 modelSpout = translateSpout * rotateSpout * scaleSpout;
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelSpout));
+//Each level halves the sectors and stacks, down to 8 sectors and 4 stacks
+void buildSphereLods(LodChain& chain, float radius, int numSectors, int numStacks) {
+	int sectors = numSectors;
+	int stacks = numStacks;
+	while (true) {
+		//Stacks only span half a circle, so they cut the same corner as twice as many sectors
+		float error = chordError(radius, std::min(sectors, stacks * 2));
+		addLodLevel(chain, meshes.add(Sphere(radius, sectors, stacks)), error);
+
+		int nextSectors = std::max(sectors / 2, std::min(sectors, 8));
+		int nextStacks = std::max(stacks / 2, std::min(stacks, 4));
+		if (nextSectors == sectors && nextStacks == stacks) {
+			break;
+		}
+		sectors = nextSectors;
+		stacks = nextStacks;
+	}
+}
 
-	//Activate VBOs for mug base
-	glBindVertexArray(cylinder.vao);
+//Builds each mesh the scene lists with its tessellation parameters, plus the light cube.
+//Parametric shapes get a chain of coarser levels, the others are exact with a single level
+void buildSceneMeshes(const SceneFile& sceneFile) {
+	for (uint32_t i = 0; i < sceneFile.meshCount(); i++) {
+		const SceneMeshDesc& desc = sceneFile.mesh(i);
+		LodChain chain;
+		MeshData mesh;
+		switch (desc.shape) {
+		case SHAPE_CUBE:
+			buildCube(mesh);
+			break;
+		case SHAPE_CYLINDER:
+			buildCylinderLods(chain, (int)desc.params[0]);
+			break;
+		case SHAPE_TORUS:
+			buildTorusLods(chain, (int)desc.params[0], (int)desc.params[1]);
+			break;
+		case SHAPE_PLANE:
+			buildPlane(mesh);
+			break;
+		case SHAPE_PYRAMID:
+			buildPyramid(mesh);
+			break;
+		case SHAPE_SPHERE:
+			buildSphereLods(chain, desc.params[0], (int)desc.params[1], (int)desc.params[2]);
+			break;
+		}
+		if (chain.size() == 0) {
+			addLodLevel(chain, meshes.add(mesh), 0.0f);
+		}
+		sceneLods.push_back(chain);
+	}
 
-	//Bind textures on mug base
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, teaPotTextureID);
+	MeshData cube;
+	buildCube(cube);
+	lightCubeMesh = meshes.add(cube);
+}
 
-	//Draw triangles that make up mug base
-	glDrawElements(GL_TRIANGLES, cylinder.nIndices, GL_UNSIGNED_SHORT, NULL);
+void addSceneNodes(SceneGraph& graph, const SceneFile& sceneFile, vector<NodeHandle>& nodes, NodeHandle root) {
+	//Scene nodes are stored parent first, the same order the graph needs
+	nodes.resize(sceneFile.nodeCount());
+	for (uint32_t i = 0; i < sceneFile.nodeCount(); i++) {
+		const SceneNodeDesc& desc = sceneFile.node(i);
+		Transform local(glm::vec3(desc.translation[0], desc.translation[1], desc.translation[2]),
+			glm::quat(desc.rotation[3], desc.rotation[0], desc.rotation[1], desc.rotation[2]),
+			glm::vec3(desc.scale[0], desc.scale[1], desc.scale[2]));
+		nodes[i] = graph.addNode(local, desc.parent == SCENE_NONE ? root : nodes[desc.parent]);
+	}
+}
 
-	//Deactivate VAO and texture for mug base
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+void buildScene(const SceneFile& sceneFile) {
+	//Copies for stress testing are tiled on the xz plane, a quarter of the layout's size apart
+	glm::vec3 spacing(0.0f);
+	if (sceneCopies > 1) {
+		vector<Aabb> layout;
+		computeSceneBounds(sceneFile, layout);
+		Aabb extent = { glm::vec3(0.0f), glm::vec3(0.0f) };
+		for (size_t i = 0; i < layout.size(); i++) {
+			extent.min = i == 0 ? layout[i].min : glm::min(extent.min, layout[i].min);
+			extent.max = i == 0 ? layout[i].max : glm::max(extent.max, layout[i].max);
+		}
+		spacing = (extent.max - extent.min) * 1.25f;
+	}
 
-	//Draw light cube
-	glUseProgram(lightProgramID);
-	glm::mat4 modelCube = glm::translate(gLightPos) * glm::scale(gLightScale);
+	for (unsigned int copy = 0; copy < sceneCopies * sceneCopies; copy++) {
+		NodeHandle root = ROOT_NODE;
+		if (sceneCopies > 1) {
+			glm::vec3 offset((copy % sceneCopies) * spacing.x, 0.0f, (copy / sceneCopies) * spacing.z);
+			root = scene.addNode(Transform(offset, glm::quat(), glm::vec3(1.0f)));
+		}
 
-	GLint lightModelLocation = glGetUniformLocation(lightProgramID, "model");
-	GLint lightViewLocation = glGetUniformLocation(lightProgramID, "view");
-	GLint lightProjLocation = glGetUniformLocation(lightProgramID, "projection");
+		vector<NodeHandle> nodes;
+		addSceneNodes(scene, sceneFile, nodes, root);
+
+		for (uint32_t i = 0; i < sceneFile.objectCount(); i++) {
+			const SceneObjectDesc& desc = sceneFile.object(i);
+			SceneObject object;
+			object.node = nodes[desc.node];
+			object.mesh = sceneLods[desc.mesh].meshes[0];
+			object.texture = desc.texture == SCENE_NONE ? noTextureSlot : textureSlots[desc.texture];
+			object.features = litFeatures(object.texture, lightmapsEnabled);
+			object.program = variantSlot(object.features);
+			object.lodChain = desc.mesh;
+			object.lodLevel = 0;
+			object.lightmap = 0;
+			sceneObjects.push_back(object);
+		}
+	}
 
-	glUniformMatrix4fv(lightModelLocation, 1, GL_FALSE, glm::value_ptr(modelCube));
-	glUniformMatrix4fv(lightViewLocation, 1, GL_FALSE, glm::value_ptr(pov));
-	glUniformMatrix4fv(lightProjLocation, 1, GL_FALSE, glm::value_ptr(projection));
+	//Light cube, moving the light means calling scene.setTranslation(lightNode, ...). Unlit and untextured, it draws its white tint
+	lightNode = addSceneObject(Transform(gLightPos, glm::quat(), gLightScale), ROOT_NODE, lightCubeMesh, noTextureSlot, 0);
 
-	//Activate VBOs for light cube
-	glBindVertexArray(cube.vao);
+	//Every new node is dirty, so the first update() fills in every object's bounds
+	cullingTable.resize((unsigned int)sceneObjects.size());
+	objectBounds.resize(sceneObjects.size());
+	objectRadii.resize(sceneObjects.size());
+	objectCenters.resize(sceneObjects.size());
+	objectScales.resize(sceneObjects.size());
+	occlusion.resize((unsigned int)sceneObjects.size());
+}
 
-	//Draw arrays that make up light cube
-	glDrawArrays(GL_TRIANGLES, 0, cube.numVertices);
+//World boxes of the scene's objects, computed on a graph of their own so nothing is registered for drawing
+void computeSceneBounds(const SceneFile& sceneFile, vector<Aabb>& bounds) {
+	SceneGraph graph;
+	vector<NodeHandle> nodes;
+	addSceneNodes(graph, sceneFile, nodes);
+	graph.update();
+
+	bounds.clear();
+	for (uint32_t i = 0; i < sceneFile.objectCount(); i++) {
+		const SceneObjectDesc& desc = sceneFile.object(i);
+		const MeshBounds& local = meshes.getBounds(sceneLods[desc.mesh].meshes[0]);
+		bounds.push_back(transformAabb(graph.getWorld(nodes[desc.node]), local.min, local.max));
+	}
+}
 
-	//Deactivate VAO for cube
-	glBindVertexArray(0);
-	glUseProgram(0);
+//Appends vertices laid out as position, normal, texture coordinate, the order the cube and pyramid tables use
+void appendVertices(MeshData& mesh, const GLfloat* verts, int vertexCount) {
+	for (int i = 0; i < vertexCount; i++) {
+		const GLfloat* v = verts + i * 8;
+		Vertex vertex;
+		vertex.position = glm::vec3(v[0], v[1], v[2]);
+		vertex.normal = glm::vec3(v[3], v[4], v[5]);
+		vertex.texCoord = glm::vec2(v[6], v[7]);
+		mesh.vertices.push_back(vertex);
+	}
+}
 
-	glfwSwapBuffers(gWindow);
+//Shapes without an index list are drawn with one index per vertex
+void appendSequentialIndices(MeshData& mesh) {
+	for (GLuint i = 0; i < (GLuint)mesh.vertices.size(); i++) {
+		mesh.indices.push_back(i);
+	}
 }
 
-void buildCube(Mesh& cube) {
+void buildCube(MeshData& cube) {
 	{
 		GLfloat verts[] = {
 		   -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
@@ -970,49 +1960,28 @@ void buildCube(Mesh& cube) {
 		const GLuint floatsPerNormal = 3;
 		const GLuint floatsPerUV = 2;
 
-		cube.numVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-
-		glGenVertexArrays(1, &cube.vao); // we can also generate multiple VAOs or buffers at the same time
-		glBindVertexArray(cube.vao);
+		int numVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 
-		// Create 2 buffers: first one for the vertex data; second one for the indices
-		glGenBuffers(1, cube.vbos);
-		glBindBuffer(GL_ARRAY_BUFFER, cube.vbos[0]); // Activates the buffer
-		glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-		// Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-		GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
-
-		// Create Vertex Attribute Pointers
-		glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-		glEnableVertexAttribArray(0);
-
-		glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-		glEnableVertexAttribArray(1);
-
-		glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-		glEnableVertexAttribArray(2);
+		appendVertices(cube, verts, numVertices);
+		appendSequentialIndices(cube);
 	}
 }
 
-void buildCylinder(Mesh& Cylinder) {
+void buildCylinder(MeshData& Cylinder, int numSegments) {
 
 	const float pi = glm::pi<float>();
-	float radius = 0.25f;
+	float radius = cylinderRadius;
 	float height = 0.7f;
-	int numSegments = 7000; //Number of segments per circle
+	//numSegments is the number of segments per circle
 
 	//Vertex and index data
 	int numVerts = (numSegments + 1) * 2; // Two circles, each with numSegments vertices (Include center vertex or program will not run!)
 	int indexCount = numSegments * 6; // Each quad has 2 triangles (6 vertices)
 
-	GLfloat* vertices = new GLfloat[numVerts * 10]; // Each vertex has 7 floats (3 for position, 4 for color) EDIT:CHANGED TO 10
-	GLushort* indices = new GLushort[indexCount];
-
-	int vIndex = 0;
-	int index = 0;
+	Cylinder.vertices.resize(numVerts);
+	Cylinder.indices.reserve(indexCount);
 
-	//Generating top and bottom of cylinder
+	//Generating top and bottom of cylinder, top circle first so the indices below can find each ring
 	for (int i = 0; i <= numSegments; ++i)
 	{
 		//Angle per segment
@@ -1021,111 +1990,50 @@ void buildCylinder(Mesh& Cylinder) {
 		float y = height / 2.0f;
 		float z = radius * std::sin(theta);
 
-		glm::vec3 vertexPosition(x, height / 2.0f, z);
-
-		float r = 0.5f;
-		float g = 0.5f;
-		float b = 0.5f;
-		float a = 1.0f;
 		GLfloat u = static_cast<GLfloat>(i) / numSegments;
 
-		//Top circle vertex coordinates in x,y,z format
-		vertices[vIndex++] = x;
-		vertices[vIndex++] = y;
-		vertices[vIndex++] = z;
+		//Side normals point straight out from the axis
+		glm::vec3 normal(std::cos(theta), 0.0f, std::sin(theta));
 
+		//Top circle vertex
+		Vertex& top = Cylinder.vertices[i];
+		top.position = glm::vec3(x, y, z);
+		top.texCoord = glm::vec2(u, 1.0f);
+		top.normal = normal;
 
-		//Top circle color coordinates in R G B A format(This combination makes gray)
-		vertices[vIndex++] = 0.5f;
-		vertices[vIndex++] = 0.5f;
-		vertices[vIndex++] = 0.5f;
-		vertices[vIndex++] = 1.0f;
-
-		//Top circle normal color coordinates
-		vertices[vIndex++] = 0.0f;
-		vertices[vIndex++] = 1.f;
-		vertices[vIndex++] = 0.0f;
-
-		// Bottom circle vertex coordinates
-		vertices[vIndex++] = x;
-		vertices[vIndex++] = -y; //This line ensures the bottom circle is opposite from the top on the y axis
-		vertices[vIndex++] = z;
-
-		//Bottom circle color coordinates (also gray)
-		vertices[vIndex++] = r;
-		vertices[vIndex++] = g;
-		vertices[vIndex++] = b;
-		vertices[vIndex++] = a;
-
-		//Bottom circle normal color coordinates
-		vertices[vIndex++] = 0.0f;
-		vertices[vIndex++] = 0.f;
-		vertices[vIndex++] = 0.0f;
+		//Bottom circle vertex, opposite from the top on the y axis
+		Vertex& bottom = Cylinder.vertices[i + numSegments + 1];
+		bottom.position = glm::vec3(x, -y, z);
+		bottom.texCoord = glm::vec2(u, 0.0f);
+		bottom.normal = normal;
 	}
 
 	//Connecting the two circles to make the base of the cylinder
 	for (int i = 0; i < numSegments; i++)
 	{
 		//Vertices for top
-		int vertex0 = i;
-		int vertex1 = i + 1;
+		GLuint vertex0 = i;
+		GLuint vertex1 = i + 1;
 		//Vertices for bottom
-		int vertex2 = i + numSegments + 1;
-		int vertex3 = i + numSegments + 2;
+		GLuint vertex2 = i + numSegments + 1;
+		GLuint vertex3 = i + numSegments + 2;
 
 		//First half of quad
-		indices[index++] = vertex0;
-		indices[index++] = vertex2;
-		indices[index++] = vertex1;
+		Cylinder.indices.push_back(vertex0);
+		Cylinder.indices.push_back(vertex2);
+		Cylinder.indices.push_back(vertex1);
 
 		//Second half of quad
-		indices[index++] = vertex1;
-		indices[index++] = vertex2;
-		indices[index++] = vertex3;
+		Cylinder.indices.push_back(vertex1);
+		Cylinder.indices.push_back(vertex2);
+		Cylinder.indices.push_back(vertex3);
 	}
-	//Generate and bind VAO
-	glGenVertexArrays(1, &Cylinder.vao);
-	glBindVertexArray(Cylinder.vao);
-
-	glGenBuffers(3, Cylinder.vbos);
-
-	//Bind vertex data to array buffer
-	glBindBuffer(GL_ARRAY_BUFFER, Cylinder.vbos[0]);
-	//Copy vertex data to VBO, pass size of data in bytes. Remember, there are 10 floats per triangle
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * numVerts * 10, vertices, GL_STATIC_DRAW);
-
-	//Bind fragment data to array buffer
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Cylinder.vbos[1]);
-	//Copy intex data to VBO, pass size of data in bites
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indexCount, indices, GL_STATIC_DRAW);
-
-	//Bind fragment data to array buffer
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Cylinder.vbos[2]);
-	//Copy inDex data to VBO, pass size of data in bites
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indexCount, indices, GL_STATIC_DRAW);
-
-	GLint stride = sizeof(float) * 10;
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * 3));
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * 7));
-	glEnableVertexAttribArray(1);
-
-	delete[] vertices;
-	delete[] indices;
-
-	Cylinder.nIndices = indexCount;
 }
 
-void buildTorus(Mesh& Torus) {
-	const float inRadius = 0.08f; //Thickness of Torus (Mug handle)
-	const float outRadius = 0.8f; //Overall radius of Torus
-	const int numSegments = 10; // Segments in Torus
-	const int numSlices = 100; // Slices in Torus, determines smoothness on mug handle
+void buildTorus(MeshData& Torus, int numSegments, int numSlices) {
+	const float inRadius = torusInRadius; //Thickness of Torus (Mug handle)
+	const float outRadius = torusOutRadius; //Overall radius of Torus
+	//numSegments is the segments in Torus, numSlices the slices, which determine smoothness on mug handle
 
 	const float pi = glm::pi<float>(); //Use GLM Math to acquire pi float
 
@@ -1133,11 +2041,8 @@ void buildTorus(Mesh& Torus) {
 	int vertexCount = numSlices * numSegments; //Each segment represents a quad composed of 2 triangles
 	int indexCount = numSlices * numSegments * 6; //Each quad has 6 vertices
 
-	GLfloat* vertices = new GLfloat[vertexCount * 7]; //7 floats per vertex, 3 being postion values (x y z), 4 being color (r g b a)
-	GLushort* indices = new GLushort[indexCount];
-
-	int vertexIndex = 0;
-	int index = 0;
+	Torus.vertices.reserve(vertexCount);
+	Torus.indices.reserve(indexCount);
 
 	//Generate indices and vertices for Torus
 	for (int slice = 0; slice < numSlices; slice++)
@@ -1159,68 +2064,37 @@ void buildTorus(Mesh& Torus) {
 			float y = (outRadius + inRadius * cosTheta) * sinPhi;
 			float z = inRadius * sinTheta;
 
-			//First three floats determine vertex position
-			vertices[vertexIndex++] = x;
-			vertices[vertexIndex++] = y;
-			vertices[vertexIndex++] = z;
-
-			//Last 4 floats determine color, this combination produces gray
-			vertices[vertexIndex++] = 0.5;
-			vertices[vertexIndex++] = 0.5;
-			vertices[vertexIndex++] = 0.5;
-			vertices[vertexIndex++] = 1.0;
+			//Normal points away from the center of the tube, texture wraps once around each direction
+			Vertex vertex;
+			vertex.position = glm::vec3(x, y, z);
+			vertex.normal = glm::vec3(cosTheta * cosPhi, cosTheta * sinPhi, sinTheta);
+			vertex.texCoord = glm::vec2((float)slice / numSlices, (float)segment / numSegments);
+			Torus.vertices.push_back(vertex);
 
 			//Indices for the next slice and next segment
 			int nextSlice = (slice + 1) % numSlices;
 			int nextSegment = (segment + 1) % numSegments;
 
 			//Indices for each vector (corner) per quad
-			int vertex0 = slice * numSegments + segment;
-			int vertex1 = slice * numSegments + nextSegment;
-			int vertex2 = nextSlice * numSegments + nextSegment;
-			int vertex3 = nextSlice * numSegments + segment;
+			GLuint vertex0 = slice * numSegments + segment;
+			GLuint vertex1 = slice * numSegments + nextSegment;
+			GLuint vertex2 = nextSlice * numSegments + nextSegment;
+			GLuint vertex3 = nextSlice * numSegments + segment;
 
 			//First half of quad (First triangle)
-			indices[index++] = vertex0;
-			indices[index++] = vertex1;
-			indices[index++] = vertex2;
+			Torus.indices.push_back(vertex0);
+			Torus.indices.push_back(vertex1);
+			Torus.indices.push_back(vertex2);
 			//Second half of quad (Second triangle)
-			indices[index++] = vertex2;
-			indices[index++] = vertex3;
-			indices[index++] = vertex0;
+			Torus.indices.push_back(vertex2);
+			Torus.indices.push_back(vertex3);
+			Torus.indices.push_back(vertex0);
 		}
 	}
-
-	//Generate and bind VAO
-	glGenVertexArrays(1, &Torus.vao);
-	glBindVertexArray(Torus.vao);
-
-	glGenBuffers(2, Torus.vbos);
-
-	//Bind vertex data to array buffer
-	glBindBuffer(GL_ARRAY_BUFFER, Torus.vbos[0]);
-	//Copy vertex data to VBO, pass size of data in bytes. Remember, there are 7 floats per triangle
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vertexCount * 7, vertices, GL_STATIC_DRAW);
-
-	//Bind fragment data to array buffer
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Torus.vbos[1]);
-	//Copy intex data to VBO, pass size of data in bites
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indexCount, indices, GL_STATIC_DRAW);
-
-	GLint stride = sizeof(float) * 7;
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * 3));
-	glEnableVertexAttribArray(1);
-
-	Torus.nIndices = indexCount;
 }
 
-void buildPyramid(Mesh& pyramid)
+void buildPyramid(MeshData& pyramid)
 {
-	// Position and Color data, commented by their indices 
 	GLfloat vertices[] = {
 		// Vertex Positions        //Normals                  // Texture coordinates
 
@@ -1253,35 +2127,13 @@ void buildPyramid(Mesh& pyramid)
 	const GLuint floatsPerNormal = 3;
 	const GLuint floatsPerTexture = 2;
 
-	pyramid.numVertices = sizeof(vertices) / (sizeof(vertices[0]) * (floatsPerVertex + floatsPerNormal + floatsPerTexture));
-
-	glGenVertexArrays(1, &pyramid.vao);
-	glBindVertexArray(pyramid.vao);
-
-	//Create 2 buffers for vertex buffer and index data
-	glGenBuffers(1, &pyramid.vbos[0]);
-
-	//Buffer for vertex data
-	glBindBuffer(GL_ARRAY_BUFFER, pyramid.vbos[0]); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerTexture);
-
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-	glEnableVertexAttribArray(0);
+	int numVertices = sizeof(vertices) / (sizeof(vertices[0]) * (floatsPerVertex + floatsPerNormal + floatsPerTexture));
 
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * floatsPerVertex));
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(2, floatsPerTexture, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
-}
-
-void buildSphere(Sphere& sphere) {
-	sphere.build(3.0, 18, 36, 1);
+	appendVertices(pyramid, vertices, numVertices);
+	appendSequentialIndices(pyramid);
 }
 
-void buildPlane(Mesh& plane) {
+void buildPlane(MeshData& plane) {
 	float vertices[] = {
 		//Position data			//Texture Coordinates		//Normals
 		-10.0f, -5.0f, -8.0f,    0.f, 1.f,					0.0f, 1.0f, 0.0f,//Top left		
@@ -1292,114 +2144,29 @@ void buildPlane(Mesh& plane) {
 		-10.0f, -5.0f, -8.0f,    0.f, 1.f,					0.0f, 1.0f, 0.0f,//Top left
 	};
 
-	//Generate and bind VAO
-	glGenVertexArrays(1, &plane.vao);
-	glBindVertexArray(plane.vao);
-
-	//Generate and bind VBOs
-	glGenBuffers(1, &plane.vbos[0]);
-	glBindBuffer(GL_ARRAY_BUFFER, plane.vbos[0]);
-	//Copy vertex data to VBO
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-	GLint vertexLoc = 0; //Column for vertex data
-	GLint textureLoc = 1; // Column for color data
-	GLint normalLoc = 2; //Column for normals data
-
-	GLint stride = sizeof(float) * 8;
-
-	glVertexAttribPointer(vertexLoc, 3, GL_FLOAT, GL_FALSE, stride, 0);
-	glEnableVertexAttribArray(vertexLoc);
-
-	glVertexAttribPointer(textureLoc, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 3));
-	glEnableVertexAttribArray(textureLoc);
-
-	glVertexAttribPointer(normalLoc, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 5));
-	glEnableVertexAttribArray(normalLoc);
-
-	plane.nIndices = 6; //nIndices = numRows in vertices array
-}
-
-void destroyMeshes(Mesh& Cylinder, Mesh& Torus, Mesh& plane, Mesh& cube, Mesh& pyramid) {
-	glDeleteVertexArrays(1, &Cylinder.vao);
-	glDeleteBuffers(1, &Cylinder.vbos[0]);
-
-	glDeleteVertexArrays(1, &Torus.vao);
-	glDeleteBuffers(1, &Torus.vbos[0]);
-
-	glDeleteVertexArrays(1, &plane.vao);
-	glDeleteBuffers(1, &plane.vbos[0]);
-
-	glDeleteVertexArrays(1, &cube.vao);
-	glDeleteBuffers(1, &cube.vbos[0]);
-
+	//Plane data is laid out as position, texture coordinate, normal
+	for (int i = 0; i < 6; i++) {
+		const float* v = vertices + i * 8;
+		Vertex vertex;
+		vertex.position = glm::vec3(v[0], v[1], v[2]);
+		vertex.texCoord = glm::vec2(v[3], v[4]);
+		vertex.normal = glm::vec3(v[5], v[6], v[7]);
+		plane.vertices.push_back(vertex);
+	}
+	appendSequentialIndices(plane);
 }
 
-bool createTexture(const char* fileName, GLuint& textureID) {
+//Loads an image into the texture arrays, its layer is assigned when the arrays are built
+bool createTexture(const char* fileName, TextureArraySet& arrays, unsigned int& image) {
+	//Every layer of an array shares one format, so images are always expanded to RGBA
 	int width, height, channels;
-	unsigned char* image = stbi_load(fileName, &width, &height, &channels, 0);
-	if (image)
-	{
-		verticalFlip(image, width, height, channels);
-
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		if (channels == 3)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-		else if (channels == 4)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-		else
-		{
-			cout << "Not implemented to handle image with " << channels << " channels" << endl;
-			return false;
-		}
-
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		stbi_image_free(image);
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		return true;
+	unsigned char* pixels = stbi_load(fileName, &width, &height, &channels, 4);
+	if (!pixels) {
+		return false;
 	}
-}
-
-void destroyTexture(GLuint textureID) {
-	glGenTextures(1, &textureID);
-}
-
-bool buildShaderProgram(const char* vertShaderSource, const char* fragShaderSource, GLuint& programID) {
-	programID = glCreateProgram();
-
-	GLuint vertShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint fragShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	glShaderSource(vertShaderID, 1, &vertShaderSource, NULL);
-	glShaderSource(fragShaderID, 1, &fragShaderSource, NULL);
-
-	//Compile vertex and fragment shaders
-	glCompileShader(vertShaderID);
-	glCompileShader(fragShaderID);
-
-	//Attatch shaders to shader program
-	glAttachShader(programID, vertShaderID);
-	glAttachShader(programID, fragShaderID);
-
-	//Link shader program
-	glLinkProgram(programID);
-
-	//Use shader program
-	glUseProgram(programID);
 
+	verticalFlip(pixels, width, height, 4);
+	image = arrays.add(pixels, width, height);
+	stbi_image_free(pixels);
 	return true;
 }
-
-void destroyShaderProgram(GLuint programID) {
-	glDeleteProgram(programID);
-}
\ No newline at end of file
@@ -0,0 +1,365 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <thread>
+
+namespace {
+	float surfaceArea(const glm::vec3& min, const glm::vec3& max) {
+		glm::vec3 extent = max - min;
+		return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+
+	enum BoxSide { OUTSIDE, INTERSECTING, INSIDE };
+
+	//Tests the corner farthest along each plane normal first, it alone decides whether the box is outside
+	BoxSide classify(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max) {
+		BoxSide side = INSIDE;
+		for (int p = 0; p < 6; p++) {
+			const glm::vec4& plane = frustum.planes[p];
+			glm::vec3 farCorner(plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z);
+			glm::vec3 nearCorner(plane.x >= 0.0f ? min.x : max.x, plane.y >= 0.0f ? min.y : max.y, plane.z >= 0.0f ? min.z : max.z);
+			if (glm::dot(glm::vec3(plane), farCorner) + plane.w < 0.0f) {
+				return OUTSIDE;
+			}
+			if (glm::dot(glm::vec3(plane), nearCorner) + plane.w < 0.0f) {
+				side = INTERSECTING;
+			}
+		}
+		return side;
+	}
+
+	//Distance at which the ray enters the box, or FLT_MAX when it misses it before maxDistance (slab test)
+	float enterDistance(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, const glm::vec3& min, const glm::vec3& max) {
+		float enter = 0.0f;
+		float exit = maxDistance;
+		for (int axis = 0; axis < 3; axis++) {
+			float slabEnter = (min[axis] - origin[axis]) * inverseDirection[axis];
+			float slabExit = (max[axis] - origin[axis]) * inverseDirection[axis];
+			enter = std::max(enter, std::min(slabEnter, slabExit));
+			exit = std::min(exit, std::max(slabEnter, slabExit));
+		}
+		return enter <= exit ? enter : FLT_MAX;
+	}
+}
+
+Aabb transformAabb(const glm::mat4& model, const glm::vec3& localMin, const glm::vec3& localMax) {
+	Aabb result;
+	result.min = result.max = glm::vec3(model[3]);
+	for (int column = 0; column < 3; column++) {
+		for (int row = 0; row < 3; row++) {
+			float a = model[column][row] * localMin[column];
+			float b = model[column][row] * localMax[column];
+			result.min[row] += std::min(a, b);
+			result.max[row] += std::max(a, b);
+		}
+	}
+	return result;
+}
+
+Bvh::Bvh() : buildBounds(0), nodesUsed(0) {
+}
+
+void Bvh::build(const std::vector<Aabb>& objectBounds, unsigned int threadCount) {
+	unsigned int count = (unsigned int)objectBounds.size();
+	nodes.clear();
+	indices.resize(count);
+	if (count == 0) {
+		return;
+	}
+
+	buildBounds = &objectBounds;
+	centroids.resize(count);
+	for (unsigned int i = 0; i < count; i++) {
+		indices[i] = i;
+		centroids[i] = (objectBounds[i].min + objectBounds[i].max) * 0.5f;
+	}
+
+	//A binary tree over n leaves never needs more than 2n - 1 nodes, so threads can claim nodes without locking
+	nodes.resize(2 * count - 1);
+	nodesUsed = 1;
+
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	//Each level that hands its left half to a new thread doubles the threads in flight
+	unsigned int spawnDepth = 0;
+	while ((1u << spawnDepth) < threadCount) {
+		spawnDepth++;
+	}
+
+	subdivide(0, 0, count, spawnDepth);
+
+	nodes.resize(nodesUsed);
+	std::vector<glm::vec3>().swap(centroids);
+	buildBounds = 0;
+}
+
+void Bvh::makeLeaf(BvhNode& node, unsigned int first, unsigned int count) {
+	node.leftOrFirst = first;
+	node.count = count;
+}
+
+void Bvh::subdivide(unsigned int nodeIndex, unsigned int first, unsigned int count, unsigned int spawnDepth) {
+	const std::vector<Aabb>& bounds = *buildBounds;
+	BvhNode& node = nodes[nodeIndex];
+
+	//Node box and the box around the object centers, which decides where splits can go
+	node.min = glm::vec3(FLT_MAX);
+	node.max = glm::vec3(-FLT_MAX);
+	glm::vec3 centroidMin(FLT_MAX);
+	glm::vec3 centroidMax(-FLT_MAX);
+	for (unsigned int i = first; i < first + count; i++) {
+		const Aabb& box = bounds[indices[i]];
+		node.min = glm::min(node.min, box.min);
+		node.max = glm::max(node.max, box.max);
+		centroidMin = glm::min(centroidMin, centroids[indices[i]]);
+		centroidMax = glm::max(centroidMax, centroids[indices[i]]);
+	}
+
+	if (count <= 2) {
+		makeLeaf(node, first, count);
+		return;
+	}
+
+	//Split along the axis the centers spread furthest on
+	glm::vec3 extent = centroidMax - centroidMin;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	if (extent[axis] <= 0.0f) {
+		makeLeaf(node, first, count);
+		return;
+	}
+
+	//Drop every object into one of BIN_COUNT slabs by its center
+	unsigned int binCounts[BIN_COUNT] = {};
+	glm::vec3 binMin[BIN_COUNT];
+	glm::vec3 binMax[BIN_COUNT];
+	for (unsigned int b = 0; b < BIN_COUNT; b++) {
+		binMin[b] = glm::vec3(FLT_MAX);
+		binMax[b] = glm::vec3(-FLT_MAX);
+	}
+	float binScale = BIN_COUNT / extent[axis];
+	for (unsigned int i = first; i < first + count; i++) {
+		unsigned int b = std::min(BIN_COUNT - 1, (unsigned int)((centroids[indices[i]][axis] - centroidMin[axis]) * binScale));
+		binCounts[b]++;
+		binMin[b] = glm::min(binMin[b], bounds[indices[i]].min);
+		binMax[b] = glm::max(binMax[b], bounds[indices[i]].max);
+	}
+
+	//Sweep from both ends so every split between bins is costed in linear time
+	float leftArea[BIN_COUNT - 1];
+	unsigned int leftCount[BIN_COUNT - 1];
+	glm::vec3 sweepMin(FLT_MAX);
+	glm::vec3 sweepMax(-FLT_MAX);
+	unsigned int sweepCount = 0;
+	for (unsigned int b = 0; b < BIN_COUNT - 1; b++) {
+		sweepCount += binCounts[b];
+		if (binCounts[b] > 0) {
+			sweepMin = glm::min(sweepMin, binMin[b]);
+			sweepMax = glm::max(sweepMax, binMax[b]);
+		}
+		leftCount[b] = sweepCount;
+		leftArea[b] = sweepCount > 0 ? surfaceArea(sweepMin, sweepMax) : 0.0f;
+	}
+
+	float bestCost = FLT_MAX;
+	unsigned int bestSplit = 0;
+	sweepMin = glm::vec3(FLT_MAX);
+	sweepMax = glm::vec3(-FLT_MAX);
+	sweepCount = 0;
+	for (unsigned int b = BIN_COUNT - 1; b > 0; b--) {
+		sweepCount += binCounts[b];
+		if (binCounts[b] > 0) {
+			sweepMin = glm::min(sweepMin, binMin[b]);
+			sweepMax = glm::max(sweepMax, binMax[b]);
+		}
+		if (sweepCount == 0 || leftCount[b - 1] == 0) {
+			continue;
+		}
+		float cost = leftArea[b - 1] * leftCount[b - 1] + surfaceArea(sweepMin, sweepMax) * sweepCount;
+		if (cost < bestCost) {
+			bestCost = cost;
+			bestSplit = b;
+		}
+	}
+
+	//Keep small nodes whole when no split beats testing every object in them
+	float leafCost = surfaceArea(node.min, node.max) * count;
+	if (count <= MAX_LEAF_SIZE && bestCost >= leafCost) {
+		makeLeaf(node, first, count);
+		return;
+	}
+
+	unsigned int* middle = std::partition(&indices[first], &indices[first] + count, [&](unsigned int object) {
+		return std::min(BIN_COUNT - 1, (unsigned int)((centroids[object][axis] - centroidMin[axis]) * binScale)) < bestSplit;
+	});
+	unsigned int leftSize = (unsigned int)(middle - &indices[first]);
+	if (leftSize == 0 || leftSize == count) {
+		//All centers landed in one bin, fall back to a median split
+		leftSize = count / 2;
+		std::nth_element(&indices[first], &indices[first] + leftSize, &indices[first] + count, [&](unsigned int a, unsigned int b) {
+			return centroids[a][axis] < centroids[b][axis];
+		});
+	}
+
+	unsigned int left = nodesUsed.fetch_add(2);
+	node.leftOrFirst = left;
+	node.count = 0;
+
+	if (spawnDepth > 0 && count >= PARALLEL_THRESHOLD) {
+		std::thread leftBuilder(&Bvh::subdivide, this, left, first, leftSize, spawnDepth - 1);
+		subdivide(left + 1, first + leftSize, count - leftSize, spawnDepth - 1);
+		leftBuilder.join();
+	}
+	else {
+		subdivide(left, first, leftSize, 0);
+		subdivide(left + 1, first + leftSize, count - leftSize, 0);
+	}
+}
+
+void Bvh::refit(const std::vector<Aabb>& objectBounds) {
+	//Children are always allocated after their parent, so a reverse walk visits them first
+	for (std::size_t i = nodes.size(); i-- > 0;) {
+		BvhNode& node = nodes[i];
+		if (node.count > 0) {
+			node.min = glm::vec3(FLT_MAX);
+			node.max = glm::vec3(-FLT_MAX);
+			for (unsigned int j = node.leftOrFirst; j < node.leftOrFirst + node.count; j++) {
+				node.min = glm::min(node.min, objectBounds[indices[j]].min);
+				node.max = glm::max(node.max, objectBounds[indices[j]].max);
+			}
+		}
+		else {
+			const BvhNode& left = nodes[node.leftOrFirst];
+			const BvhNode& right = nodes[node.leftOrFirst + 1];
+			node.min = glm::min(left.min, right.min);
+			node.max = glm::max(left.max, right.max);
+		}
+	}
+}
+
+unsigned int Bvh::cullFrustum(const Frustum& frustum, std::vector<unsigned int>& visible) const {
+	std::size_t visibleBefore = visible.size();
+	if (nodes.empty()) {
+		return 0;
+	}
+	cullSubtree(frustum, 0, visible);
+	return size() - (unsigned int)(visible.size() - visibleBefore);
+}
+
+void Bvh::getSubtreeRoots(unsigned int minCount, std::vector<unsigned int>& roots) const {
+	roots.clear();
+	if (nodes.empty()) {
+		return;
+	}
+
+	//Split the widest level further until there are enough subtrees, leaves are kept as they are
+	roots.push_back(0);
+	bool split = true;
+	while (roots.size() < minCount && split) {
+		split = false;
+		std::vector<unsigned int> next;
+		for (std::size_t i = 0; i < roots.size(); i++) {
+			const BvhNode& node = nodes[roots[i]];
+			if (node.count > 0) {
+				next.push_back(roots[i]);
+				continue;
+			}
+			next.push_back(node.leftOrFirst);
+			next.push_back(node.leftOrFirst + 1);
+			split = true;
+		}
+		roots.swap(next);
+	}
+}
+
+void Bvh::cullSubtree(const Frustum& frustum, unsigned int root, std::vector<unsigned int>& visible) const {
+	unsigned int stack[64];
+	unsigned int stackSize = 0;
+	stack[stackSize++] = root;
+	while (stackSize > 0) {
+		unsigned int nodeIndex = stack[--stackSize];
+		const BvhNode& node = nodes[nodeIndex];
+
+		BoxSide side = classify(frustum, node.min, node.max);
+		if (side == OUTSIDE) {
+			continue;
+		}
+		if (side == INSIDE || node.count > 0) {
+			//Leaves are small enough that their objects are accepted with the leaf
+			appendSubtree(nodeIndex, visible);
+			continue;
+		}
+
+		//Depth stays far below 64 for any realistic split, but never overflow if a tree comes out degenerate
+		if (stackSize + 2 > 64) {
+			appendSubtree(nodeIndex, visible);
+			continue;
+		}
+		stack[stackSize++] = node.leftOrFirst + 1;
+		stack[stackSize++] = node.leftOrFirst;
+	}
+}
+
+float Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, const RayVisitor& visit) const {
+	if (nodes.empty()) {
+		return maxDistance;
+	}
+	glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	if (enterDistance(origin, inverseDirection, maxDistance, nodes[0].min, nodes[0].max) == FLT_MAX) {
+		return maxDistance;
+	}
+
+	//Each entry keeps the distance its box was entered at, so boxes behind a hit found since are skipped
+	unsigned int stack[64];
+	float stackDistance[64];
+	unsigned int stackSize = 0;
+	stack[stackSize] = 0;
+	stackDistance[stackSize++] = 0.0f;
+	std::vector<unsigned int> overflow;
+	while (stackSize > 0) {
+		stackSize--;
+		if (stackDistance[stackSize] > maxDistance) {
+			continue;
+		}
+		const BvhNode& node = nodes[stack[stackSize]];
+		if (node.count > 0 || stackSize + 2 > 64) {
+			//Same fallback as cullSubtree when a degenerate tree would overflow the stack
+			overflow.clear();
+			appendSubtree((unsigned int)(&node - &nodes[0]), overflow);
+			for (std::size_t i = 0; i < overflow.size(); i++) {
+				maxDistance = std::min(maxDistance, visit(overflow[i], maxDistance));
+			}
+			continue;
+		}
+
+		//Children the ray reaches before the current hit, the nearer one popped first
+		unsigned int left = node.leftOrFirst;
+		unsigned int right = node.leftOrFirst + 1;
+		float leftDistance = enterDistance(origin, inverseDirection, maxDistance, nodes[left].min, nodes[left].max);
+		float rightDistance = enterDistance(origin, inverseDirection, maxDistance, nodes[right].min, nodes[right].max);
+		if (leftDistance > rightDistance) {
+			std::swap(left, right);
+			std::swap(leftDistance, rightDistance);
+		}
+		if (rightDistance != FLT_MAX) {
+			stack[stackSize] = right;
+			stackDistance[stackSize++] = rightDistance;
+		}
+		if (leftDistance != FLT_MAX) {
+			stack[stackSize] = left;
+			stackDistance[stackSize++] = leftDistance;
+		}
+	}
+	return maxDistance;
+}
+
+void Bvh::appendSubtree(unsigned int nodeIndex, std::vector<unsigned int>& visible) const {
+	const BvhNode& node = nodes[nodeIndex];
+	if (node.count > 0) {
+		visible.insert(visible.end(), &indices[node.leftOrFirst], &indices[node.leftOrFirst] + node.count);
+		return;
+	}
+	appendSubtree(node.leftOrFirst, visible);
+	appendSubtree(node.leftOrFirst + 1, visible);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <vector>
+
+//GLM Math headers
+#include <glm/glm.hpp>
+
+//Frustum culling header
+#include "frustumCulling.h"
+
+//Axis aligned bounding box
+struct Aabb {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+//Box around a local box moved by a model matrix (Arvo's method, exact for the transformed corners)
+Aabb transformAabb(const glm::mat4& model, const glm::vec3& localMin, const glm::vec3& localMax);
+
+//32 byte node, children of an inner node are stored next to each other
+struct BvhNode {
+	glm::vec3 min;
+	unsigned int leftOrFirst; //Left child index for inner nodes, first entry in the index list for leaves
+	glm::vec3 max;
+	unsigned int count; //Objects in a leaf, 0 for inner nodes
+};
+
+//Bounding volume hierarchy over object boxes, built with the binned surface area heuristic.
+//Whole subtrees are accepted or rejected by a single box test during frustum culling
+class Bvh
+{
+public:
+	static const unsigned int MAX_LEAF_SIZE = 4; //Leaves are only forced when a node has at most this many objects
+	static const unsigned int BIN_COUNT = 16; //Candidate split positions per node
+	static const unsigned int PARALLEL_THRESHOLD = 16384; //Smaller subtrees are built on the thread that reached them
+
+	Bvh();
+
+	//threadCount 0 uses every hardware thread, 1 builds serially
+	void build(const std::vector<Aabb>& objectBounds, unsigned int threadCount = 0);
+
+	//Recomputes node boxes from new object boxes without changing the tree, for objects that moved
+	void refit(const std::vector<Aabb>& objectBounds);
+
+	//Appends the index of every object whose box touches the frustum, returns how many were culled
+	unsigned int cullFrustum(const Frustum& frustum, std::vector<unsigned int>& visible) const;
+
+	//Roots of at least minCount disjoint subtrees covering every object (fewer if the tree runs out of inner nodes),
+	//so threads can cull one subtree each with cullSubtree
+	void getSubtreeRoots(unsigned int minCount, std::vector<unsigned int>& roots) const;
+	void cullSubtree(const Frustum& frustum, unsigned int root, std::vector<unsigned int>& visible) const;
+
+	//Tests an object against a ray, returns the distance of its nearest hit or maxDistance when it is missed
+	typedef std::function<float(unsigned int object, float maxDistance)> RayVisitor;
+
+	//Visits every object whose box the ray enters before the nearest hit found so far, nearer child first,
+	//and returns the distance of the nearest hit, or maxDistance when nothing was hit
+	float raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, const RayVisitor& visit) const;
+
+	bool empty() const { return nodes.empty(); }
+	unsigned int size() const { return (unsigned int)indices.size(); }
+	unsigned int nodeCount() const { return (unsigned int)nodes.size(); }
+
+private:
+	void subdivide(unsigned int nodeIndex, unsigned int first, unsigned int count, unsigned int spawnDepth);
+	void makeLeaf(BvhNode& node, unsigned int first, unsigned int count);
+	void appendSubtree(unsigned int nodeIndex, std::vector<unsigned int>& visible) const;
+
+	std::vector<BvhNode> nodes;
+	std::vector<unsigned int> indices; //Object indices grouped so every leaf owns a contiguous range
+
+	//Build state
+	const std::vector<Aabb>* buildBounds;
+	std::vector<glm::vec3> centroids;
+	std::atomic<unsigned int> nodesUsed;
+};
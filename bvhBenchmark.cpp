@@ -0,0 +1,128 @@
+#include "bvhBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+//GLM Math headers
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+
+namespace {
+	typedef chrono::high_resolution_clock Clock;
+
+	double elapsedMs(Clock::time_point start) {
+		return chrono::duration<double, milli>(Clock::now() - start).count();
+	}
+
+	//Copies of the layout side by side on the xz plane, cut off at exactly objectCount objects
+	void tileLayout(const vector<Aabb>& layout, unsigned int objectCount, vector<Aabb>& objects) {
+		Aabb extent = layout[0];
+		for (size_t i = 1; i < layout.size(); i++) {
+			extent.min = glm::min(extent.min, layout[i].min);
+			extent.max = glm::max(extent.max, layout[i].max);
+		}
+		glm::vec3 spacing = (extent.max - extent.min) * 1.25f;
+
+		unsigned int copies = (objectCount + (unsigned int)layout.size() - 1) / (unsigned int)layout.size();
+		unsigned int side = (unsigned int)ceil(sqrt((double)copies));
+
+		objects.clear();
+		objects.reserve(objectCount);
+		for (unsigned int copy = 0; copy < copies; copy++) {
+			glm::vec3 offset((copy % side) * spacing.x, 0.0f, (copy / side) * spacing.z);
+			for (size_t i = 0; i < layout.size() && objects.size() < objectCount; i++) {
+				Aabb box = { layout[i].min + offset, layout[i].max + offset };
+				objects.push_back(box);
+			}
+		}
+	}
+
+	//Cameras spread over the grid looking across it, like someone walking through a large scene
+	void makeFrustums(const vector<Aabb>& objects, vector<Frustum>& frustums) {
+		Aabb extent = objects[0];
+		for (size_t i = 1; i < objects.size(); i++) {
+			extent.min = glm::min(extent.min, objects[i].min);
+			extent.max = glm::max(extent.max, objects[i].max);
+		}
+
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+		const int cameraCount = 16;
+		for (int i = 0; i < cameraCount; i++) {
+			float t = (i + 0.5f) / cameraCount;
+			glm::vec3 eye(extent.min.x + (extent.max.x - extent.min.x) * t, 10.0f, extent.min.z + (extent.max.z - extent.min.z) * t);
+			float angle = t * 6.2831853f;
+			glm::vec3 target = eye + glm::vec3(cos(angle), -0.3f, sin(angle));
+			frustums.push_back(extractFrustum(projection * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f))));
+		}
+	}
+}
+
+int runBvhBenchmark(const vector<Aabb>& layoutBounds) {
+	if (layoutBounds.empty()) {
+		cerr << "BVH benchmark needs a scene with at least one object" << endl;
+		return EXIT_FAILURE;
+	}
+
+	unsigned int threads = max(1u, thread::hardware_concurrency());
+	cout << "BVH benchmark: " << layoutBounds.size() << " objects per layout copy, " << threads << " threads" << endl;
+
+	const unsigned int sizes[] = { 10000, 100000, 1000000 };
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		vector<Aabb> objects;
+		tileLayout(layoutBounds, sizes[s], objects);
+
+		vector<Frustum> frustums;
+		makeFrustums(objects, frustums);
+
+		Bvh bvh;
+		Clock::time_point start = Clock::now();
+		bvh.build(objects, 1);
+		double serialBuildMs = elapsedMs(start);
+
+		start = Clock::now();
+		bvh.build(objects, threads);
+		double parallelBuildMs = elapsedMs(start);
+
+		start = Clock::now();
+		bvh.refit(objects);
+		double refitMs = elapsedMs(start);
+
+		//Same objects as spheres in the linear table
+		CullingTable table;
+		table.resize((unsigned int)objects.size());
+		for (unsigned int i = 0; i < (unsigned int)objects.size(); i++) {
+			table.set(i, (objects[i].min + objects[i].max) * 0.5f, glm::length(objects[i].max - objects[i].min) * 0.5f);
+		}
+
+		vector<unsigned int> visible;
+		visible.reserve(objects.size());
+		size_t bvhVisible = 0;
+		start = Clock::now();
+		for (size_t f = 0; f < frustums.size(); f++) {
+			visible.clear();
+			bvh.cullFrustum(frustums[f], visible);
+			bvhVisible += visible.size();
+		}
+		double bvhQueryMs = elapsedMs(start) / frustums.size();
+
+		size_t linearVisible = 0;
+		start = Clock::now();
+		for (size_t f = 0; f < frustums.size(); f++) {
+			visible.clear();
+			table.cull(frustums[f], visible);
+			linearVisible += visible.size();
+		}
+		double linearQueryMs = elapsedMs(start) / frustums.size();
+
+		cout << objects.size() << " objects, " << bvh.nodeCount() << " nodes: build " << serialBuildMs << " ms serial / "
+			<< parallelBuildMs << " ms parallel, refit " << refitMs << " ms, query " << bvhQueryMs << " ms ("
+			<< bvhVisible / frustums.size() << " visible) vs linear " << linearQueryMs << " ms ("
+			<< linearVisible / frustums.size() << " visible)" << endl;
+	}
+	return EXIT_SUCCESS;
+}
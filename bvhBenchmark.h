@@ -0,0 +1,9 @@
+#pragma once
+#include <vector>
+
+//BVH header
+#include "bvh.h"
+
+//Builds, refits and queries BVHs over 10k to 1M objects made by tiling the given layout on a grid,
+//and compares the queries with the linear SIMD sphere test. Prints a report and returns an exit code
+int runBvhBenchmark(const std::vector<Aabb>& layoutBounds);
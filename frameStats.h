@@ -0,0 +1,100 @@
+#pragma once
+#include <iostream>
+
+//Counters collected while a frame is built and submitted
+struct FrameStats {
+	unsigned int items; //Render queue items submitted
+	unsigned int drawCalls; //Draw calls issued after merging
+	unsigned int indirectCommands; //Commands inside the multi-draw calls
+	unsigned int programBinds;
+	unsigned int textureBinds;
+	unsigned int vaoBinds;
+	unsigned int bindsElided; //Program, texture and VAO binds skipped because the previous item already had them bound
+	unsigned int matricesComputed; //World matrices the scene graph recomputed
+	unsigned int objectsCulled; //Scene objects rejected by the frustum before submission
+	unsigned int lodTrianglesSaved; //Triangles not drawn because an object used a coarser level than its finest
+	unsigned int conditionalDraws; //Draws issued inside conditional rendering
+	unsigned int objectsOccluded; //Objects whose last occlusion query found no visible samples
+	unsigned int occlusionQueries; //Bounding box proxies drawn inside occlusion queries
+	double occlusionMs; //CPU time spent collecting results and drawing proxies
+	unsigned int jobThreads; //Threads that culled and built the draw lists
+	double buildMs; //CPU time from the scene update to the merged draw list, without the occlusion readback
+	double snapshotWaitMs; //Time the GL thread waited for the simulation thread to finish the frame
+	unsigned int inputEvents; //Input events folded into the frame's single camera update
+	unsigned int shadowCasters; //Objects drawn into the shadow map, 0 on frames that reuse it
+	unsigned int pointLights; //Clustered point lights that reached the view
+	double clusterMs; //CPU time spent binning them into clusters
+	unsigned int ringBytes; //Instances, commands and uniforms written into the frame's ring buffer section
+	double fenceWaitMs; //CPU time spent waiting for the GPU to finish with that section
+	unsigned int droppedFlushes; //Queue flushes that found the section full and drew nothing
+};
+
+//Averages frame statistics and prints them once per second
+class FrameStatsReporter
+{
+public:
+	FrameStatsReporter() : frames(0), lastReport(0.0), total() {}
+
+	void frame(const FrameStats& stats, double now) {
+		total.items += stats.items;
+		total.drawCalls += stats.drawCalls;
+		total.indirectCommands += stats.indirectCommands;
+		total.programBinds += stats.programBinds;
+		total.textureBinds += stats.textureBinds;
+		total.vaoBinds += stats.vaoBinds;
+		total.bindsElided += stats.bindsElided;
+		total.matricesComputed += stats.matricesComputed;
+		total.objectsCulled += stats.objectsCulled;
+		total.lodTrianglesSaved += stats.lodTrianglesSaved;
+		total.conditionalDraws += stats.conditionalDraws;
+		total.objectsOccluded += stats.objectsOccluded;
+		total.occlusionQueries += stats.occlusionQueries;
+		total.occlusionMs += stats.occlusionMs;
+		total.jobThreads = stats.jobThreads;
+		total.buildMs += stats.buildMs;
+		total.snapshotWaitMs += stats.snapshotWaitMs;
+		total.inputEvents += stats.inputEvents;
+		total.shadowCasters += stats.shadowCasters;
+		total.pointLights += stats.pointLights;
+		total.clusterMs += stats.clusterMs;
+		total.ringBytes += stats.ringBytes;
+		total.fenceWaitMs += stats.fenceWaitMs;
+		total.droppedFlushes += stats.droppedFlushes;
+		frames++;
+
+		if (now - lastReport < 1.0) {
+			return;
+		}
+
+		double elapsed = now - lastReport;
+		std::cout << "Frame stats: " << frames / elapsed << " fps, per frame "
+			<< total.items / frames << " items, "
+			<< total.drawCalls / frames << " draws ("
+			<< total.indirectCommands / frames << " indirect commands), "
+			<< total.programBinds / frames << " program / "
+			<< total.textureBinds / frames << " texture / "
+			<< total.vaoBinds / frames << " VAO binds, "
+			<< total.bindsElided / frames << " binds elided, "
+			<< total.matricesComputed / frames << " matrices computed, "
+			<< total.objectsCulled / frames << " objects culled, "
+			<< total.lodTrianglesSaved / frames << " triangles saved by LOD, "
+			<< total.objectsOccluded / frames << " occluded of " << total.conditionalDraws / frames << " conditional draws ("
+			<< total.occlusionQueries / frames << " queries, " << total.occlusionMs / frames << " ms), "
+			<< total.buildMs / frames << " ms to build on " << total.jobThreads << " threads ("
+			<< total.snapshotWaitMs / frames << " ms waited for it), "
+			<< total.inputEvents / frames << " input events, "
+			<< total.shadowCasters / frames << " shadow casters redrawn, "
+			<< total.pointLights / frames << " point lights (" << total.clusterMs / frames << " ms to cluster), "
+			<< total.ringBytes / frames << " bytes streamed (" << total.fenceWaitMs / frames << " ms fence wait, "
+			<< total.droppedFlushes << " flushes dropped for ring space)" << std::endl;
+
+		frames = 0;
+		lastReport = now;
+		total = FrameStats();
+	}
+
+private:
+	unsigned int frames;
+	double lastReport;
+	FrameStats total;
+};
@@ -0,0 +1,22 @@
+#include "frameUniforms.h"
+
+#include <cstring>
+
+FrameUniformBuffer::FrameUniformBuffer() : alignment(256) {
+}
+
+void FrameUniformBuffer::create() {
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+}
+
+bool FrameUniformBuffer::update(RingBuffer& ring, const FrameUniforms& uniforms) {
+	RingAllocation range = ring.allocate(sizeof(FrameUniforms), alignment);
+	if (range.data == NULL) {
+		return false;
+	}
+	std::memcpy(range.data, &uniforms, sizeof(FrameUniforms));
+
+	//Programs declare the block with layout(binding = 0), so nothing has to be bound per program
+	glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, ring.getBuffer(), range.offset, range.size);
+	return true;
+}
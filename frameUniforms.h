@@ -0,0 +1,51 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstddef>
+
+//GLM Math headers
+#include <glm/glm.hpp>
+
+#include "ringBuffer.h"
+
+const GLuint FRAME_UNIFORM_BINDING = 0; //Uniform buffer binding point of the FrameBlock block
+
+//Values shared by every program for one frame, mirrors the std140 FrameBlock block in the shaders.
+//vec3 values are stored as vec4 because std140 aligns a vec3 to 16 bytes anyway
+struct FrameUniforms {
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 viewPosition; //xyz used
+	glm::vec4 lightPosition; //xyz used
+	glm::vec4 lightColor; //xyz used
+	glm::vec2 uvScale;
+	float ambientStrength; //Fraction of lightColor every lit surface receives regardless of visibility
+	float padding; //std140 starts the next mat4 on a 16 byte boundary
+	glm::mat4 lightSpace; //World to the shadow map's clip space
+	glm::vec4 clusterParams; //Cluster tile width and height in framebuffer pixels (width 0 skips point lights), slice scale, near plane
+};
+
+static_assert(offsetof(FrameUniforms, view) == 0, "FrameUniforms.view must match std140 FrameBlock");
+static_assert(offsetof(FrameUniforms, projection) == 64, "FrameUniforms.projection must match std140 FrameBlock");
+static_assert(offsetof(FrameUniforms, viewPosition) == 128, "FrameUniforms.viewPosition must match std140 FrameBlock");
+static_assert(offsetof(FrameUniforms, lightPosition) == 144, "FrameUniforms.lightPosition must match std140 FrameBlock");
+static_assert(offsetof(FrameUniforms, lightColor) == 160, "FrameUniforms.lightColor must match std140 FrameBlock");
+static_assert(offsetof(FrameUniforms, uvScale) == 176, "FrameUniforms.uvScale must match std140 FrameBlock");
+static_assert(offsetof(FrameUniforms, ambientStrength) == 184, "FrameUniforms.ambientStrength must match std140 FrameBlock");
+static_assert(offsetof(FrameUniforms, lightSpace) == 192, "FrameUniforms.lightSpace must match std140 FrameBlock");
+static_assert(offsetof(FrameUniforms, clusterParams) == 256, "FrameUniforms.clusterParams must match std140 FrameBlock");
+static_assert(sizeof(FrameUniforms) == 272, "FrameUniforms must match the std140 size of FrameBlock");
+
+//Streams the block through the frame's ring buffer section, so each frame binds its own copy to FRAME_UNIFORM_BINDING
+class FrameUniformBuffer
+{
+public:
+	FrameUniformBuffer();
+
+	void create(); //Reads the uniform buffer offset alignment the ring allocations must respect
+
+	//Writes the whole block into the ring and binds that range, false when the section is full
+	bool update(RingBuffer& ring, const FrameUniforms& uniforms);
+
+private:
+	GLint alignment; //GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+};
@@ -0,0 +1,140 @@
+#include "frustumCulling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#define CULL_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULL_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+	//Padding entries sit at the origin with a radius so negative that no plane ever accepts them
+	const float paddingRadius = -1.0e30f;
+
+	//Reports the set bits of a lane mask as object indices
+	void appendVisible(unsigned int mask, unsigned int first, unsigned int count, std::vector<unsigned int>& visible) {
+		while (mask != 0) {
+			unsigned int lane = 0;
+			while (((mask >> lane) & 1u) == 0) {
+				lane++;
+			}
+			mask &= mask - 1;
+			if (first + lane < count) {
+				visible.push_back(first + lane);
+			}
+		}
+	}
+}
+
+Frustum extractFrustum(const glm::mat4& viewProjection) {
+	//Rows of the combined matrix, GLM stores columns
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++) {
+		row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	Frustum frustum;
+	frustum.planes[0] = row[3] + row[0]; //Left
+	frustum.planes[1] = row[3] - row[0]; //Right
+	frustum.planes[2] = row[3] + row[1]; //Bottom
+	frustum.planes[3] = row[3] - row[1]; //Top
+	frustum.planes[4] = row[3] + row[2]; //Near
+	frustum.planes[5] = row[3] - row[2]; //Far
+
+	//Normalize so plane distances are in world units and can be compared with radii
+	for (int i = 0; i < 6; i++) {
+		float length = glm::length(glm::vec3(frustum.planes[i]));
+		frustum.planes[i] = frustum.planes[i] / length;
+	}
+	return frustum;
+}
+
+void transformSphere(const glm::mat4& model, const glm::vec3& localCenter, float localRadius, glm::vec3& center, float& worldRadius) {
+	center = glm::vec3(model * glm::vec4(localCenter, 1.0f));
+
+	float scaleX = glm::length(glm::vec3(model[0]));
+	float scaleY = glm::length(glm::vec3(model[1]));
+	float scaleZ = glm::length(glm::vec3(model[2]));
+	worldRadius = localRadius * std::max(scaleX, std::max(scaleY, scaleZ));
+}
+
+void CullingTable::resize(unsigned int newCount) {
+	count = newCount;
+	unsigned int padded = (newCount + LANES - 1) / LANES * LANES;
+	centerX.assign(padded, 0.0f);
+	centerY.assign(padded, 0.0f);
+	centerZ.assign(padded, 0.0f);
+	radius.assign(padded, paddingRadius);
+}
+
+void CullingTable::set(unsigned int index, const glm::vec3& center, float sphereRadius) {
+	centerX[index] = center.x;
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+	radius[index] = sphereRadius;
+}
+
+unsigned int CullingTable::cull(const Frustum& frustum, std::vector<unsigned int>& visible) const {
+	return cullRange(frustum, 0, count, visible);
+}
+
+unsigned int CullingTable::cullRange(const Frustum& frustum, unsigned int first, unsigned int end, std::vector<unsigned int>& visible) const {
+	std::size_t visibleBefore = visible.size();
+	end = std::min(end, count);
+	unsigned int padded = std::min((end + LANES - 1) / LANES * LANES, (unsigned int)radius.size());
+
+#if defined(CULL_AVX)
+	//8 spheres per iteration, a sphere survives while its distance to every plane is at least -radius
+	for (unsigned int i = first; i < padded; i += 8) {
+		__m256 x = _mm256_loadu_ps(&centerX[i]);
+		__m256 y = _mm256_loadu_ps(&centerY[i]);
+		__m256 z = _mm256_loadu_ps(&centerZ[i]);
+		__m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radius[i]));
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			const glm::vec4& plane = frustum.planes[p];
+			__m256 distance = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+				_mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+		}
+		appendVisible((unsigned int)_mm256_movemask_ps(inside), i, end, visible);
+	}
+#elif defined(CULL_SSE)
+	//4 spheres per iteration, a sphere survives while its distance to every plane is at least -radius
+	for (unsigned int i = first; i < padded; i += 4) {
+		__m128 x = _mm_loadu_ps(&centerX[i]);
+		__m128 y = _mm_loadu_ps(&centerY[i]);
+		__m128 z = _mm_loadu_ps(&centerZ[i]);
+		__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			const glm::vec4& plane = frustum.planes[p];
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+		}
+		appendVisible((unsigned int)_mm_movemask_ps(inside), i, end, visible);
+	}
+#else
+	for (unsigned int i = first; i < end; i++) {
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++) {
+			const glm::vec4& plane = frustum.planes[p];
+			inside = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w >= -radius[i];
+		}
+		if (inside) {
+			visible.push_back(i);
+		}
+	}
+#endif
+
+	return end - first - (unsigned int)(visible.size() - visibleBefore);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <vector>
+
+//GLM Math headers
+#include <glm/glm.hpp>
+
+//Six planes facing into the view volume, xyz is the unit normal and w the distance term
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+//Gribb and Hartmann extraction, works for perspective and orthographic projections alike
+Frustum extractFrustum(const glm::mat4& viewProjection);
+
+//World space bounding spheres of every scene object, stored as separate arrays so 4 or 8 objects
+//can be tested against a plane with one SIMD instruction
+class CullingTable
+{
+public:
+	static const unsigned int LANES = 8; //Arrays are padded to a multiple of the widest SIMD width
+
+	CullingTable() : count(0) {}
+
+	void resize(unsigned int count);
+	void set(unsigned int index, const glm::vec3& center, float radius);
+	unsigned int size() const { return count; }
+
+	//Appends the index of every object that touches the frustum to visible, returns how many were culled
+	unsigned int cull(const Frustum& frustum, std::vector<unsigned int>& visible) const;
+
+	//Same test over the objects in [first, end), so threads can split the table. first must be a multiple of LANES
+	unsigned int cullRange(const Frustum& frustum, unsigned int first, unsigned int end, std::vector<unsigned int>& visible) const;
+
+private:
+	unsigned int count;
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+};
+
+//World bounding sphere of a local sphere moved by a model matrix, the radius grows by the largest axis scale
+void transformSphere(const glm::mat4& model, const glm::vec3& localCenter, float localRadius, glm::vec3& center, float& worldRadius);
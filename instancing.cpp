@@ -0,0 +1,81 @@
+#include "instancing.h"
+
+#include <cstddef>
+#include <cstring>
+
+InstanceBuffer::InstanceBuffer() : ringBuffer(0), range(), storageAlignment(1), idBuffer(0), capacity(0) {
+}
+
+void InstanceBuffer::create() {
+	glGenBuffers(1, &idBuffer);
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+}
+
+void InstanceBuffer::destroy() {
+	if (idBuffer != 0) {
+		glDeleteBuffers(1, &idBuffer);
+		idBuffer = 0;
+	}
+	ringBuffer = 0;
+	capacity = 0;
+	instances.clear();
+}
+
+GLuint InstanceBuffer::add(const glm::mat4& model, const glm::mat3& normal, const glm::vec4& tint, GLuint materialID, GLuint lightmapID) {
+	InstanceData instance = {};
+	instance.model = model;
+	for (int column = 0; column < 3; column++) {
+		instance.normalMatrix[column] = glm::vec4(normal[column], 0.0f);
+	}
+	instance.tint = tint;
+	instance.materialID = materialID;
+	instance.lightmapID = lightmapID;
+	instances.push_back(instance);
+	return (GLuint)(instances.size() - 1);
+}
+
+bool InstanceBuffer::upload(RingBuffer& ring) {
+	if (instances.empty()) {
+		return true;
+	}
+
+	//The ID buffer is static between resizes. Its name stays the same, so the VAO that references it stays valid
+	if ((GLsizeiptr)instances.size() > capacity) {
+		capacity = (GLsizeiptr)instances.size() * 2;
+
+		std::vector<GLuint> ids(capacity);
+		for (GLsizeiptr i = 0; i < capacity; i++) {
+			ids[i] = (GLuint)i;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	//Written straight into mapped memory the GPU is not reading, its section's fence has already passed
+	range = ring.allocate(instances.size() * sizeof(InstanceData), storageAlignment);
+	if (range.data == NULL) {
+		return false;
+	}
+	std::memcpy(range.data, instances.data(), range.size);
+	ringBuffer = ring.getBuffer();
+	return true;
+}
+
+void InstanceBuffer::bind() const {
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, INSTANCE_STORAGE_BINDING, ringBuffer, range.offset, range.size);
+}
+
+void attachInstanceAttributes(GLuint vao, GLuint idBuffer) {
+	glBindVertexArray(vao);
+
+	glEnableVertexAttribArray(INSTANCE_ID_LOCATION);
+	glVertexAttribIFormat(INSTANCE_ID_LOCATION, 1, GL_UNSIGNED_INT, 0);
+	glVertexAttribBinding(INSTANCE_ID_LOCATION, INSTANCE_BINDING);
+
+	//Advance once per instance instead of once per vertex, offset by each command's baseInstance
+	glBindVertexBuffer(INSTANCE_BINDING, idBuffer, 0, sizeof(GLuint));
+	glVertexBindingDivisor(INSTANCE_BINDING, 1);
+
+	glBindVertexArray(0);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+
+//GLM Math headers
+#include <glm/glm.hpp>
+
+#include "ringBuffer.h"
+
+//Per-draw data read by the shaders from a shader storage buffer, mirrors the std430 DrawData struct
+struct InstanceData {
+	glm::mat4 model;
+	glm::vec4 normalMatrix[3]; //Columns of the mat3 that moves normals to world space, std430 pads each to a vec4
+	glm::vec4 tint; //Multiplied with the texture color
+	GLuint materialID; //Layer of the bound texture array the instance samples
+	GLuint lightmapID; //Entry of the lightmap rectangle buffer, 0 for objects lit at runtime
+	GLuint padding[2]; //std430 rounds the struct up to the 16 byte alignment of its mat4
+};
+
+static_assert(sizeof(InstanceData) == 144, "InstanceData must match the std430 layout of DrawData");
+
+const GLuint INSTANCE_ID_LOCATION = 3; //uint attribute holding the instance's index into the storage buffer
+const GLuint INSTANCE_BINDING = 8; //Vertex buffer binding index, kept clear of the indices glVertexAttribPointer uses
+const GLuint INSTANCE_STORAGE_BINDING = 0; //Shader storage binding point of the DrawData array
+
+//Frame-wide stream of per-draw data, every group of repeated shapes is a contiguous range inside it
+class InstanceBuffer
+{
+public:
+	InstanceBuffer();
+
+	void create();
+	void destroy();
+
+	void clear() { instances.clear(); }
+	GLuint add(const glm::mat4& model, const glm::mat3& normal, const glm::vec4& tint = glm::vec4(1.0f), GLuint materialID = 0,
+		GLuint lightmapID = 0); //Returns the index of the new instance
+	GLuint size() const { return (GLuint)instances.size(); }
+
+	//Copies every instance added this frame into the ring's current section, false when it does not fit
+	bool upload(RingBuffer& ring);
+	void bind() const; //Binds this frame's range of the ring to INSTANCE_STORAGE_BINDING
+
+	GLuint getIdBuffer() const { return idBuffer; }
+
+private:
+	GLuint ringBuffer;
+	RingAllocation range; //Where this frame's instances were written
+	GLint storageAlignment; //GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+	GLuint idBuffer; //0, 1, 2, ... read once per instance, so baseInstance selects the first DrawData of a command
+	GLsizeiptr capacity; //Draw IDs currently allocated on the GPU
+	std::vector<InstanceData> instances;
+};
+
+//Points the per-instance draw ID attribute of a VAO at the ID buffer, once at startup
+void attachInstanceAttributes(GLuint vao, GLuint idBuffer);
@@ -0,0 +1,97 @@
+#include "jobSystem.h"
+
+#include <algorithm>
+
+using namespace std;
+
+JobSystem::JobSystem() : job(NULL), jobCount(0), jobGrain(1), nextItem(0), busyWorkers(0), generation(0), stopping(false) {
+}
+
+JobSystem::~JobSystem() {
+	stop();
+}
+
+void JobSystem::start(unsigned int threadCount) {
+	stop();
+	if (threadCount == 0) {
+		threadCount = max(1u, thread::hardware_concurrency());
+	}
+
+	stopping = false;
+	for (unsigned int i = 1; i < threadCount; i++) {
+		workers.push_back(thread(&JobSystem::workerLoop, this, i));
+	}
+}
+
+void JobSystem::stop() {
+	{
+		lock_guard<mutex> lock(jobMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	workers.clear();
+}
+
+void JobSystem::parallelFor(unsigned int count, unsigned int grain, const Job& function) {
+	grain = max(grain, 1u);
+
+	//Not worth waking anyone for a single chunk
+	if (workers.empty() || count <= grain) {
+		if (count > 0) {
+			function(0, count, 0);
+		}
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(jobMutex);
+		job = &function;
+		jobCount = count;
+		jobGrain = grain;
+		nextItem = 0;
+		busyWorkers = (unsigned int)workers.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	runChunks(0);
+
+	//Workers may still be finishing their last chunk
+	unique_lock<mutex> lock(jobMutex);
+	done.wait(lock, [this] { return busyWorkers == 0; });
+	job = NULL;
+}
+
+void JobSystem::workerLoop(unsigned int thread) {
+	unsigned int seen = 0;
+	while (true) {
+		{
+			unique_lock<mutex> lock(jobMutex);
+			wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+			if (stopping) {
+				return;
+			}
+			seen = generation;
+		}
+
+		runChunks(thread);
+
+		lock_guard<mutex> lock(jobMutex);
+		if (--busyWorkers == 0) {
+			done.notify_one();
+		}
+	}
+}
+
+void JobSystem::runChunks(unsigned int thread) {
+	while (true) {
+		unsigned int begin = nextItem.fetch_add(jobGrain);
+		if (begin >= jobCount) {
+			return;
+		}
+		(*job)(begin, min(begin + jobGrain, jobCount), thread);
+	}
+}
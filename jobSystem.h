@@ -0,0 +1,44 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Fixed pool of worker threads for splitting one frame's CPU work. The thread that calls parallelFor works too,
+//so a pool of N threads has N - 1 workers and thread index 0 is always the caller
+class JobSystem
+{
+public:
+	//begin and end bound the chunk of items to process, thread picks the caller's per-thread output
+	typedef std::function<void(unsigned int begin, unsigned int end, unsigned int thread)> Job;
+
+	JobSystem();
+	~JobSystem();
+
+	void start(unsigned int threadCount); //0 uses every hardware thread
+	void stop();
+
+	unsigned int getThreadCount() const { return (unsigned int)workers.size() + 1; }
+
+	//Hands out [0, count) in chunks of grain items until every chunk is done, then returns
+	void parallelFor(unsigned int count, unsigned int grain, const Job& job);
+
+private:
+	void workerLoop(unsigned int thread);
+	void runChunks(unsigned int thread);
+
+	std::vector<std::thread> workers;
+	std::mutex jobMutex;
+	std::condition_variable wake; //Signalled when a new parallelFor starts or the pool stops
+	std::condition_variable done; //Signalled when the last worker finishes its chunks
+
+	const Job* job;
+	unsigned int jobCount;
+	unsigned int jobGrain;
+	std::atomic<unsigned int> nextItem;
+	unsigned int busyWorkers;
+	unsigned int generation; //Bumped per parallelFor, so a worker never runs the same one twice
+	bool stopping;
+};
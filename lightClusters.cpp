@@ -0,0 +1,146 @@
+#include "lightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	unsigned int clusterIndex(unsigned int x, unsigned int y, unsigned int z) {
+		return (z * LightClusters::TILES_Y + y) * LightClusters::TILES_X + x;
+	}
+
+	//Tile holding a normalized device coordinate, clamped to the grid
+	unsigned int tileOf(float ndc, unsigned int tiles) {
+		float tile = (ndc * 0.5f + 0.5f) * tiles;
+		return (unsigned int)std::min(std::max(tile, 0.0f), (float)(tiles - 1));
+	}
+
+	//Copies an array into the ring and binds it, an empty array still gets one element so the binding stays valid
+	bool uploadArray(RingBuffer& ring, GLint alignment, GLuint binding, const void* data, std::size_t bytes, std::size_t elementSize) {
+		RingAllocation range = ring.allocate(std::max(bytes, elementSize), alignment);
+		if (range.data == NULL) {
+			return false;
+		}
+		if (bytes > 0) {
+			std::memcpy(range.data, data, bytes);
+		}
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, ring.getBuffer(), range.offset, range.size);
+		return true;
+	}
+}
+
+void LightClusters::setLights(const std::vector<PointLight>& newLights) {
+	lights.assign(newLights.begin(), newLights.begin() + std::min(newLights.size(), (std::size_t)MAX_LIGHTS));
+
+	//Lights are static, so their spheres go into the table once
+	table.resize((unsigned int)lights.size());
+	for (unsigned int i = 0; i < lights.size(); i++) {
+		table.set(i, glm::vec3(lights[i].positionRadius), lights[i].positionRadius.w);
+	}
+}
+
+float LightClusters::sliceScale(float nearPlane, float farPlane) {
+	return SLICES / std::log(farPlane / nearPlane);
+}
+
+void LightClusters::build(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane, ClusterLists& lists) {
+	lists.lights.clear();
+	lists.indices.clear();
+	lists.ranges.assign(CLUSTER_COUNT, ClusterRange());
+
+	visible.clear();
+	table.cull(extractFrustum(projection * view), visible);
+
+	//Bin each light into the clusters touched by its view space box. The box is projected corner by corner,
+	//which covers perspective and orthographic projections alike
+	float scale = sliceScale(nearPlane, farPlane);
+	boxes.clear();
+	for (std::size_t v = 0; v < visible.size(); v++) {
+		const PointLight& light = lights[visible[v]];
+		float radius = light.positionRadius.w;
+		glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(light.positionRadius), 1.0f));
+
+		float nearDepth = std::max(-center.z - radius, nearPlane);
+		float farDepth = std::min(-center.z + radius, farPlane);
+		if (nearDepth > farDepth) {
+			continue;
+		}
+
+		glm::vec2 ndcMin(1.0f);
+		glm::vec2 ndcMax(-1.0f);
+		for (int corner = 0; corner < 8; corner++) {
+			glm::vec4 point((corner & 1) ? center.x + radius : center.x - radius,
+				(corner & 2) ? center.y + radius : center.y - radius,
+				(corner & 4) ? -farDepth : -nearDepth, 1.0f);
+			glm::vec4 clip = projection * point;
+			glm::vec2 ndc = glm::vec2(clip) / clip.w;
+			ndcMin = glm::min(ndcMin, ndc);
+			ndcMax = glm::max(ndcMax, ndc);
+		}
+
+		ClusterBox box;
+		box.minX = tileOf(ndcMin.x, TILES_X);
+		box.maxX = tileOf(ndcMax.x, TILES_X);
+		box.minY = tileOf(ndcMin.y, TILES_Y);
+		box.maxY = tileOf(ndcMax.y, TILES_Y);
+		box.minZ = (unsigned int)std::min(std::max(std::log(nearDepth / nearPlane) * scale, 0.0f), (float)(SLICES - 1));
+		box.maxZ = (unsigned int)std::min(std::max(std::log(farDepth / nearPlane) * scale, 0.0f), (float)(SLICES - 1));
+
+		//Indices refer to the light's place in this frame's list
+		boxes.push_back(box);
+		lists.lights.push_back(light);
+	}
+
+	//Count, then lay the clusters out back to back, then fill. Clusters past MAX_INDICES lose their lights
+	for (std::size_t v = 0; v < boxes.size(); v++) {
+		const ClusterBox& box = boxes[v];
+		for (unsigned int z = box.minZ; z <= box.maxZ; z++) {
+			for (unsigned int y = box.minY; y <= box.maxY; y++) {
+				for (unsigned int x = box.minX; x <= box.maxX; x++) {
+					lists.ranges[clusterIndex(x, y, z)].count++;
+				}
+			}
+		}
+	}
+	GLuint offset = 0;
+	for (unsigned int c = 0; c < CLUSTER_COUNT; c++) {
+		lists.ranges[c].offset = offset;
+		lists.ranges[c].count = std::min(lists.ranges[c].count, MAX_INDICES - offset);
+		offset += lists.ranges[c].count;
+	}
+	lists.indices.resize(offset);
+
+	std::vector<ClusterRange> cursor(lists.ranges);
+	for (std::size_t v = 0; v < boxes.size(); v++) {
+		const ClusterBox& box = boxes[v];
+		for (unsigned int z = box.minZ; z <= box.maxZ; z++) {
+			for (unsigned int y = box.minY; y <= box.maxY; y++) {
+				for (unsigned int x = box.minX; x <= box.maxX; x++) {
+					ClusterRange& slot = cursor[clusterIndex(x, y, z)];
+					if (slot.count > 0) {
+						lists.indices[slot.offset++] = (GLuint)v;
+						slot.count--;
+					}
+				}
+			}
+		}
+	}
+}
+
+LightClusterBuffer::LightClusterBuffer() : alignment(1) {
+}
+
+void LightClusterBuffer::create() {
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+}
+
+bool LightClusterBuffer::upload(RingBuffer& ring, const ClusterLists& lists) {
+	return uploadArray(ring, alignment, LIGHT_STORAGE_BINDING, lists.lights.data(), lists.lights.size() * sizeof(PointLight), sizeof(PointLight)) &&
+		uploadArray(ring, alignment, CLUSTER_STORAGE_BINDING, lists.ranges.data(), lists.ranges.size() * sizeof(ClusterRange), sizeof(ClusterRange)) &&
+		uploadArray(ring, alignment, LIGHT_INDEX_STORAGE_BINDING, lists.indices.data(), lists.indices.size() * sizeof(GLuint), sizeof(GLuint));
+}
+
+GLsizeiptr LightClusterBuffer::maxFrameBytes() {
+	return LightClusters::MAX_LIGHTS * sizeof(PointLight) + LightClusters::CLUSTER_COUNT * sizeof(ClusterRange) +
+		LightClusters::MAX_INDICES * sizeof(GLuint) + 3 * 256;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+
+//GLM Math headers
+#include <glm/glm.hpp>
+
+#include "frustumCulling.h"
+#include "ringBuffer.h"
+
+//One point light as the shaders read it, mirrors the std430 PointLight struct
+struct PointLight {
+	glm::vec4 positionRadius; //World position, w is the distance at which the light fades out
+	glm::vec4 color; //rgb used
+};
+
+static_assert(sizeof(PointLight) == 32, "PointLight must match the std430 layout of the shader's PointLight");
+
+//Where a cluster's lights start in the index list and how many there are
+struct ClusterRange {
+	GLuint offset;
+	GLuint count;
+};
+
+//Shader storage binding points of the clustered lighting buffers, DrawBuffer holds binding 0
+const GLuint LIGHT_STORAGE_BINDING = 1;
+const GLuint CLUSTER_STORAGE_BINDING = 2;
+const GLuint LIGHT_INDEX_STORAGE_BINDING = 3;
+
+//Everything the fragment shader needs to light one frame. Lights holds only the lights that reached the view,
+//indices point into it
+struct ClusterLists {
+	std::vector<PointLight> lights;
+	std::vector<ClusterRange> ranges; //One per cluster
+	std::vector<GLuint> indices;
+};
+
+//Splits the view volume into TILES_X by TILES_Y screen tiles and SLICES depth slices, spaced exponentially
+//so near clusters stay small, and lists for every cluster the lights whose sphere reaches it.
+//The lights are first culled against the frustum 8 at a time through a CullingTable, then each survivor
+//is binned into the block of clusters its view space box covers
+class LightClusters
+{
+public:
+	//The lit fragment shader repeats these three
+	static const unsigned int TILES_X = 16;
+	static const unsigned int TILES_Y = 9;
+	static const unsigned int SLICES = 24;
+	static const unsigned int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+	static const unsigned int MAX_LIGHTS = 1024;
+	static const unsigned int MAX_INDICES = CLUSTER_COUNT * 32; //Room for 32 lights in an average cluster
+
+	void setLights(const std::vector<PointLight>& lights); //At most MAX_LIGHTS are kept
+	unsigned int getLightCount() const { return (unsigned int)lights.size(); }
+
+	//nearPlane and farPlane must be the ones projection was built with
+	void build(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane, ClusterLists& lists);
+
+	//Multiplies the log of a view depth over the near plane into a slice index, the shader's slice formula
+	static float sliceScale(float nearPlane, float farPlane);
+
+private:
+	//Block of clusters one light covers, inclusive
+	struct ClusterBox {
+		unsigned int minX, maxX, minY, maxY, minZ, maxZ;
+	};
+
+	std::vector<PointLight> lights;
+	CullingTable table;
+	std::vector<unsigned int> visible;
+	std::vector<ClusterBox> boxes; //One per light in the frame's list
+};
+
+//Streams a frame's cluster lists through the ring and binds them to their storage bindings
+class LightClusterBuffer
+{
+public:
+	LightClusterBuffer();
+
+	void create(); //Reads the storage buffer offset alignment the ring allocations must respect
+
+	//False when the ring's section is full
+	bool upload(RingBuffer& ring, const ClusterLists& lists);
+
+	//Ring bytes the largest possible frame needs, alignment slack included
+	static GLsizeiptr maxFrameBytes();
+
+private:
+	GLint alignment; //GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+};
@@ -0,0 +1,373 @@
+#include "lightmapBaker.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+//GLM Math headers
+#include <glm/gtc/constants.hpp>
+
+using namespace std;
+
+namespace {
+	//Offset along the normal that keeps a ray from hitting the surface it starts on
+	const float rayBias = 0.001f;
+
+	//Per-texel random sequence, so threads need no shared generator and a bake is repeatable
+	float nextRandom(unsigned int& state) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (state >> 8) * (1.0f / 16777216.0f);
+	}
+
+	//Cosine weighted direction around normal, so averaging the samples gives the diffuse integral directly
+	glm::vec3 cosineDirection(const glm::vec3& normal, unsigned int& state) {
+		float u = nextRandom(state);
+		float angle = 2.0f * glm::pi<float>() * nextRandom(state);
+		float radius = sqrt(u);
+
+		glm::vec3 helper = fabs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+		glm::vec3 tangent = glm::normalize(glm::cross(helper, normal));
+		glm::vec3 bitangent = glm::cross(normal, tangent);
+		return tangent * (radius * cos(angle)) + bitangent * (radius * sin(angle)) + normal * sqrt(max(0.0f, 1.0f - u));
+	}
+
+	//Moller-Trumbore, u and v weight the second and third corner
+	bool intersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c,
+		float& distance, float& u, float& v) {
+		glm::vec3 edge1 = b - a;
+		glm::vec3 edge2 = c - a;
+		glm::vec3 p = glm::cross(direction, edge2);
+		float determinant = glm::dot(edge1, p);
+		if (fabs(determinant) < 1.0e-12f) {
+			return false;
+		}
+		float inverse = 1.0f / determinant;
+		glm::vec3 toOrigin = origin - a;
+		u = glm::dot(toOrigin, p) * inverse;
+		if (u < 0.0f || u > 1.0f) {
+			return false;
+		}
+		glm::vec3 q = glm::cross(toOrigin, edge1);
+		v = glm::dot(direction, q) * inverse;
+		if (v < 0.0f || u + v > 1.0f) {
+			return false;
+		}
+		distance = glm::dot(edge2, q) * inverse;
+		return distance > 0.0f;
+	}
+
+	const Vertex& corner(const MeshData& mesh, unsigned int triangle, unsigned int index) {
+		return mesh.vertices[mesh.indices[triangle * 3 + index]];
+	}
+}
+
+LightmapBaker::LightmapBaker() : height(0) {
+	rects.push_back(glm::vec4(0.0f));
+}
+
+unsigned int LightmapBaker::addObject(const MeshData* mesh, const glm::mat4& model) {
+	unsigned int meshIndex = 0;
+	while (meshIndex < meshes.size() && meshes[meshIndex].data != mesh) {
+		meshIndex++;
+	}
+	if (meshIndex == meshes.size()) {
+		meshes.push_back(BakeMesh());
+		meshes.back().data = mesh;
+		meshes.back().cellsPerRow = lightmapCellsPerRow((unsigned int)(mesh->indices.size() / 3));
+	}
+
+	BakeObject object;
+	object.mesh = meshIndex;
+	object.model = model;
+	object.inverseModel = glm::inverse(model);
+	object.normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+	object.cellTexels = MIN_CELL_TEXELS;
+	object.x = object.y = 0;
+	objects.push_back(object);
+	rects.push_back(glm::vec4(0.0f));
+	return (unsigned int)objects.size();
+}
+
+bool LightmapBaker::layout(float texelsPerUnit) {
+	//Cells are sized so the longest edge in the object gets texelsPerUnit texels per world unit
+	for (size_t i = 0; i < objects.size(); i++) {
+		BakeObject& object = objects[i];
+		const MeshData& mesh = *meshes[object.mesh].data;
+		float longest = 0.0f;
+		for (size_t v = 0; v + 2 < mesh.indices.size(); v += 3) {
+			glm::vec3 a = glm::vec3(object.model * glm::vec4(mesh.vertices[mesh.indices[v]].position, 1.0f));
+			glm::vec3 b = glm::vec3(object.model * glm::vec4(mesh.vertices[mesh.indices[v + 1]].position, 1.0f));
+			glm::vec3 c = glm::vec3(object.model * glm::vec4(mesh.vertices[mesh.indices[v + 2]].position, 1.0f));
+			longest = max(longest, max(glm::length(b - a), max(glm::length(c - b), glm::length(a - c))));
+		}
+		float texels = ceil(longest * texelsPerUnit);
+		object.cellTexels = (unsigned int)min(max(texels, (float)MIN_CELL_TEXELS), (float)MAX_CELL_TEXELS);
+	}
+
+	//Shelf packing, tallest rectangles first
+	vector<unsigned int> order(objects.size());
+	for (unsigned int i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+		return meshes[objects[a].mesh].cellsPerRow * objects[a].cellTexels > meshes[objects[b].mesh].cellsPerRow * objects[b].cellTexels;
+	});
+	unsigned int shelfX = 0;
+	unsigned int shelfY = 0;
+	unsigned int shelfHeight = 0;
+	for (size_t i = 0; i < order.size(); i++) {
+		BakeObject& object = objects[order[i]];
+		unsigned int size = meshes[object.mesh].cellsPerRow * object.cellTexels;
+		if (size > ATLAS_WIDTH) {
+			return false;
+		}
+		if (shelfX + size > ATLAS_WIDTH) {
+			shelfY += shelfHeight;
+			shelfX = 0;
+			shelfHeight = 0;
+		}
+		object.x = shelfX;
+		object.y = shelfY;
+		shelfX += size;
+		shelfHeight = max(shelfHeight, size);
+	}
+	height = shelfY + shelfHeight;
+	if (height > MAX_ATLAS_HEIGHT) {
+		return false;
+	}
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		const BakeObject& object = objects[i];
+		float scale = (float)object.cellTexels;
+		rects[i + 1] = glm::vec4(scale / ATLAS_WIDTH, scale / height, (float)object.x / ATLAS_WIDTH, (float)object.y / height);
+	}
+	return true;
+}
+
+void LightmapBaker::buildTexels() {
+	//Every texel of a cell stands for a point of the cell's triangle. Texels outside the triangle take the nearest
+	//point inside it, which pads the chart for bilinear filtering
+	const glm::vec2 cornerA(LIGHTMAP_CELL_MARGIN, LIGHTMAP_CELL_MARGIN);
+	float legLength = 1.0f - 2.0f * LIGHTMAP_CELL_MARGIN;
+
+	texels.clear();
+	for (size_t i = 0; i < objects.size(); i++) {
+		const BakeObject& object = objects[i];
+		const BakeMesh& bakeMesh = meshes[object.mesh];
+		const MeshData& mesh = *bakeMesh.data;
+		unsigned int triangleCount = (unsigned int)(mesh.indices.size() / 3);
+		for (unsigned int t = 0; t < triangleCount; t++) {
+			unsigned int cellX = t % bakeMesh.cellsPerRow;
+			unsigned int cellY = t / bakeMesh.cellsPerRow;
+			for (unsigned int ty = 0; ty < object.cellTexels; ty++) {
+				for (unsigned int tx = 0; tx < object.cellTexels; tx++) {
+					//The triangle's legs run along the cell's axes, so its barycentrics are the scaled offsets from cornerA
+					glm::vec2 inCell((tx + 0.5f) / object.cellTexels, (ty + 0.5f) / object.cellTexels);
+					float u = max((inCell.x - cornerA.x) / legLength, 0.0f);
+					float v = max((inCell.y - cornerA.y) / legLength, 0.0f);
+					if (u + v > 1.0f) {
+						float excess = (u + v - 1.0f) * 0.5f;
+						u = max(u - excess, 0.0f);
+						v = min(1.0f - u, max(v - excess, 0.0f));
+					}
+					float w = 1.0f - u - v;
+
+					const Vertex& a = corner(mesh, t, 0);
+					const Vertex& b = corner(mesh, t, 1);
+					const Vertex& c = corner(mesh, t, 2);
+					BakeTexel texel;
+					texel.position = glm::vec3(object.model * glm::vec4(a.position * w + b.position * u + c.position * v, 1.0f));
+					texel.normal = glm::normalize(object.normalMatrix * (a.normal * w + b.normal * u + c.normal * v));
+					texel.pixel = (object.y + cellY * object.cellTexels + ty) * ATLAS_WIDTH + object.x + cellX * object.cellTexels + tx;
+					texels.push_back(texel);
+				}
+			}
+		}
+	}
+}
+
+unsigned int LightmapBaker::pixelAt(const BakeObject& object, unsigned int triangle, float u, float v) const {
+	const BakeMesh& bakeMesh = meshes[object.mesh];
+	glm::vec2 inCell = glm::vec2(LIGHTMAP_CELL_MARGIN, LIGHTMAP_CELL_MARGIN) + glm::vec2(u, v) * (1.0f - 2.0f * LIGHTMAP_CELL_MARGIN);
+	unsigned int tx = min((unsigned int)(inCell.x * object.cellTexels), object.cellTexels - 1);
+	unsigned int ty = min((unsigned int)(inCell.y * object.cellTexels), object.cellTexels - 1);
+	unsigned int cellX = triangle % bakeMesh.cellsPerRow;
+	unsigned int cellY = triangle / bakeMesh.cellsPerRow;
+	return (object.y + cellY * object.cellTexels + ty) * ATLAS_WIDTH + object.x + cellX * object.cellTexels + tx;
+}
+
+bool LightmapBaker::trace(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, unsigned int& pixel) const {
+	bool hit = false;
+	scene.raycast(origin, direction, maxDistance, [&](unsigned int objectIndex, float objectMax) {
+		//Model matrices are affine, so the local ray keeps the world ray's distances
+		const BakeObject& object = objects[objectIndex];
+		const MeshData& mesh = *meshes[object.mesh].data;
+		glm::vec3 localOrigin = glm::vec3(object.inverseModel * glm::vec4(origin, 1.0f));
+		glm::vec3 localDirection = glm::vec3(object.inverseModel * glm::vec4(direction, 0.0f));
+
+		return meshTriangles[object.mesh].raycast(localOrigin, localDirection, objectMax, [&](unsigned int triangle, float triangleMax) {
+			float distance, u, v;
+			if (!intersectTriangle(localOrigin, localDirection, corner(mesh, triangle, 0).position, corner(mesh, triangle, 1).position,
+				corner(mesh, triangle, 2).position, distance, u, v) || distance >= triangleMax) {
+				return triangleMax;
+			}
+			hit = true;
+			pixel = pixelAt(object, triangle, u, v);
+			return distance;
+		});
+	});
+	return hit;
+}
+
+bool LightmapBaker::bake(JobSystem& jobs, const LightmapSettings& settings) {
+	if (objects.empty()) {
+		return false;
+	}
+
+	//A scene too large for the atlas at the requested density is baked coarser, down to the smallest cells
+	float texelsPerUnit = settings.texelsPerUnit;
+	while (!layout(texelsPerUnit)) {
+		bool smallest = true;
+		for (size_t i = 0; i < objects.size(); i++) {
+			smallest = smallest && objects[i].cellTexels == MIN_CELL_TEXELS;
+		}
+		if (smallest) {
+			cerr << "Lightmap: " << objects.size() << " objects do not fit a " << ATLAS_WIDTH << " x " << MAX_ATLAS_HEIGHT << " atlas" << endl;
+			return false;
+		}
+		texelsPerUnit *= 0.5f;
+	}
+
+	//Acceleration structures: one over each mesh's triangles in local space, one over the objects in world space
+	meshTriangles.clear();
+	for (size_t m = 0; m < meshes.size(); m++) {
+		const MeshData& mesh = *meshes[m].data;
+		vector<Aabb> boxes(mesh.indices.size() / 3);
+		for (size_t t = 0; t < boxes.size(); t++) {
+			boxes[t].min = boxes[t].max = corner(mesh, (unsigned int)t, 0).position;
+			for (unsigned int c = 1; c < 3; c++) {
+				boxes[t].min = glm::min(boxes[t].min, corner(mesh, (unsigned int)t, c).position);
+				boxes[t].max = glm::max(boxes[t].max, corner(mesh, (unsigned int)t, c).position);
+			}
+		}
+		meshTriangles.emplace_back();
+		meshTriangles.back().build(boxes, 1);
+	}
+	vector<Aabb> objectBoxes(objects.size());
+	for (size_t i = 0; i < objects.size(); i++) {
+		const MeshData& mesh = *meshes[objects[i].mesh].data;
+		glm::vec3 localMin(FLT_MAX);
+		glm::vec3 localMax(-FLT_MAX);
+		for (size_t v = 0; v < mesh.vertices.size(); v++) {
+			localMin = glm::min(localMin, mesh.vertices[v].position);
+			localMax = glm::max(localMax, mesh.vertices[v].position);
+		}
+		objectBoxes[i] = transformAabb(objects[i].model, localMin, localMax);
+	}
+	scene.build(objectBoxes, 1);
+
+	buildTexels();
+	unsigned int texelCount = (unsigned int)texels.size();
+	unsigned int pixelCount = ATLAS_WIDTH * height;
+	vector<glm::vec3> direct(pixelCount, glm::vec3(0.0f));
+	vector<float> visibility(pixelCount, 1.0f);
+
+	//Direct light: one shadow ray per texel toward the point light, Lambert like the runtime shader
+	jobs.parallelFor(texelCount, 256, [&](unsigned int begin, unsigned int end, unsigned int) {
+		for (unsigned int i = begin; i < end; i++) {
+			const BakeTexel& texel = texels[i];
+			glm::vec3 toLight = settings.lightPosition - texel.position;
+			float distance = glm::length(toLight);
+			glm::vec3 direction = toLight / distance;
+			float impact = max(glm::dot(texel.normal, direction), 0.0f);
+
+			unsigned int blocker;
+			glm::vec3 origin = texel.position + texel.normal * rayBias;
+			bool shadowed = impact > 0.0f && trace(origin, direction, distance - rayBias, blocker);
+			bool visible = impact > 0.0f && !shadowed;
+			visibility[texel.pixel] = visible ? 1.0f : 0.0f;
+			direct[texel.pixel] = visible ? impact * settings.lightColor : glm::vec3(0.0f);
+		}
+	});
+
+	//Each bounce gathers what the previous one left on the surfaces the texel's hemisphere rays hit
+	vector<glm::vec3> incoming(direct);
+	vector<glm::vec3> bounced(pixelCount, glm::vec3(0.0f));
+	vector<glm::vec3> gathered(pixelCount, glm::vec3(0.0f));
+	for (unsigned int bounce = 0; bounce < settings.bounces; bounce++) {
+		jobs.parallelFor(texelCount, 64, [&](unsigned int begin, unsigned int end, unsigned int) {
+			for (unsigned int i = begin; i < end; i++) {
+				const BakeTexel& texel = texels[i];
+				unsigned int state = (i + 1) * 2654435761u ^ (bounce + 1) * 40503u;
+				glm::vec3 origin = texel.position + texel.normal * rayBias;
+				glm::vec3 sum(0.0f);
+				for (unsigned int s = 0; s < settings.samples; s++) {
+					unsigned int pixel;
+					if (trace(origin, cosineDirection(texel.normal, state), FLT_MAX, pixel)) {
+						sum += incoming[pixel];
+					}
+				}
+				gathered[texel.pixel] = sum * (settings.albedo / max(settings.samples, 1u));
+			}
+		});
+		for (unsigned int p = 0; p < pixelCount; p++) {
+			bounced[p] += gathered[p];
+		}
+		incoming.swap(gathered);
+	}
+
+	pixels.assign(pixelCount, glm::vec4(0.0f));
+	glm::vec3 ambient = settings.ambient * settings.lightColor;
+	for (unsigned int i = 0; i < texelCount; i++) {
+		unsigned int p = texels[i].pixel;
+		pixels[p] = glm::vec4(ambient + direct[p] + bounced[p], visibility[p]);
+	}
+	cout << "Lightmap: " << objects.size() << " objects, " << texelCount << " texels in a " << ATLAS_WIDTH << " x " << height
+		<< " atlas at " << texelsPerUnit << " texels per unit, " << settings.bounces << " bounces of " << settings.samples << " rays" << endl;
+	return true;
+}
+
+LightmapAtlas::LightmapAtlas() : texture(0), rectBuffer(0) {
+}
+
+void LightmapAtlas::create(const LightmapBaker* baker) {
+	destroy();
+	const glm::vec4 black(0.0f);
+	const glm::vec4 noRect(0.0f);
+	GLsizei width = baker != NULL ? (GLsizei)baker->getWidth() : 1;
+	GLsizei height = baker != NULL ? (GLsizei)baker->getHeight() : 1;
+	const glm::vec4* pixels = baker != NULL ? baker->getPixels().data() : &black;
+
+	//Half floats keep irradiance above 1 where the light is bright, the shader scales it by the texture color
+	glGenTextures(1, &texture);
+	glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, width, height);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_FLOAT, pixels);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glActiveTexture(GL_TEXTURE0);
+
+	GLsizeiptr rectCount = baker != NULL ? (GLsizeiptr)baker->getRects().size() : 1;
+	glGenBuffers(1, &rectBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, rectBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, rectCount * sizeof(glm::vec4), baker != NULL ? baker->getRects().data() : &noRect, GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHTMAP_RECT_STORAGE_BINDING, rectBuffer);
+}
+
+void LightmapAtlas::destroy() {
+	if (texture != 0) {
+		glDeleteTextures(1, &texture);
+		texture = 0;
+	}
+	if (rectBuffer != 0) {
+		glDeleteBuffers(1, &rectBuffer);
+		rectBuffer = 0;
+	}
+}
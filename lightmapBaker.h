@@ -0,0 +1,107 @@
+#pragma once
+#include <GL/glew.h>
+#include <deque>
+#include <vector>
+
+//GLM Math headers
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "jobSystem.h"
+#include "meshRegistry.h"
+
+const GLuint LIGHTMAP_TEXTURE_UNIT = 2; //Texture unit the atlas stays bound to, next to the shadow map
+const GLuint LIGHTMAP_RECT_STORAGE_BINDING = 4; //Shader storage binding point of the lightmapRects array
+
+//Lighting the baker reproduces, the runtime lit shader's point light, ambient term and a few diffuse bounces
+struct LightmapSettings {
+	glm::vec3 lightPosition;
+	glm::vec3 lightColor;
+	float ambient; //Fraction of lightColor every surface receives regardless of visibility
+	float albedo; //Reflectance the bounces assume for every surface, textures are not read on the CPU
+	unsigned int bounces;
+	unsigned int samples; //Hemisphere rays per texel and bounce
+	float texelsPerUnit; //Lightmap texels along one world unit of an object's longest triangle edge
+};
+
+//Ray traces the lighting of static objects into one lightmap atlas. Every object gets a rectangle of cells,
+//one cell per triangle of its unwrapped mesh, sized from its largest triangle. Rays are traced through a BVH
+//over the objects' world boxes and a BVH over each mesh's triangles, the same Bvh the frustum culling uses
+class LightmapBaker
+{
+public:
+	static const unsigned int ATLAS_WIDTH = 2048;
+	static const unsigned int MAX_ATLAS_HEIGHT = 2048;
+	static const unsigned int MIN_CELL_TEXELS = 6; //Keeps LIGHTMAP_CELL_MARGIN at least half a texel
+	static const unsigned int MAX_CELL_TEXELS = 64;
+
+	LightmapBaker();
+
+	//mesh must come from a MeshRegistry with lightmapping enabled and outlive the bake.
+	//Returns the object's lightmap ID, its index into getRects()
+	unsigned int addObject(const MeshData* mesh, const glm::mat4& model);
+
+	//False when the objects do not fit the atlas
+	bool bake(JobSystem& jobs, const LightmapSettings& settings);
+
+	unsigned int getWidth() const { return ATLAS_WIDTH; }
+	unsigned int getHeight() const { return height; }
+	//rgb is the baked irradiance, a the fraction of the light the texel sees directly
+	const std::vector<glm::vec4>& getPixels() const { return pixels; }
+	//Per lightmap ID, xy scales lightmap cell coordinates into the atlas and zw offsets them. Entry 0 is unused
+	const std::vector<glm::vec4>& getRects() const { return rects; }
+
+private:
+	struct BakeMesh {
+		const MeshData* data;
+		unsigned int cellsPerRow;
+	};
+
+	struct BakeObject {
+		unsigned int mesh;
+		glm::mat4 model;
+		glm::mat4 inverseModel;
+		glm::mat3 normalMatrix;
+		unsigned int cellTexels;
+		unsigned int x; //Atlas corner of the object's rectangle
+		unsigned int y;
+	};
+
+	//Surface point a lightmap texel stands for
+	struct BakeTexel {
+		glm::vec3 position;
+		glm::vec3 normal;
+		unsigned int pixel;
+	};
+
+	bool layout(float texelsPerUnit); //False when the atlas overflows
+	void buildTexels();
+	//Nearest surface the ray hits, false when it escapes the scene. pixel is the atlas texel covering the hit
+	bool trace(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, unsigned int& pixel) const;
+	unsigned int pixelAt(const BakeObject& object, unsigned int triangle, float u, float v) const;
+
+	std::vector<BakeMesh> meshes;
+	std::deque<Bvh> meshTriangles; //Per mesh, over its triangles' local boxes. A deque because a Bvh cannot be moved
+	std::vector<BakeObject> objects;
+	Bvh scene; //Over the objects' world boxes
+	std::vector<BakeTexel> texels;
+	unsigned int height;
+	std::vector<glm::vec4> pixels;
+	std::vector<glm::vec4> rects;
+};
+
+//The baked atlas on the GPU and the rectangle of every lightmap ID, both bound once for the program's lifetime
+class LightmapAtlas
+{
+public:
+	LightmapAtlas();
+
+	//Without a baker the atlas is a single black texel and only the unused rectangle 0 exists,
+	//so the shader's bindings stay valid when nothing was baked
+	void create(const LightmapBaker* baker);
+	void destroy();
+
+private:
+	GLuint texture;
+	GLuint rectBuffer;
+};
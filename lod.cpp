@@ -0,0 +1,45 @@
+#include "lod.h"
+
+#include <algorithm>
+#include <cmath>
+
+const float LodSelector::HYSTERESIS = 0.75f;
+
+void LodChain::add(MeshHandle mesh, float error, unsigned int triangleCount) {
+	meshes.push_back(mesh);
+	errors.push_back(error);
+	triangles.push_back(triangleCount);
+}
+
+float chordError(float radius, int segments) {
+	return radius * (1.0f - std::cos(3.14159265f / segments));
+}
+
+LodSelector::LodSelector() : threshold(1.0f), pixelsPerUnit(1.0f), perspective(true) {
+}
+
+void LodSelector::setPerspective(float viewportHeight, float fovY) {
+	pixelsPerUnit = viewportHeight / (2.0f * std::tan(fovY * 0.5f));
+	perspective = true;
+}
+
+void LodSelector::setOrthographic(float viewportHeight, float viewHeight) {
+	pixelsPerUnit = viewportHeight / viewHeight;
+	perspective = false;
+}
+
+unsigned int LodSelector::select(const LodChain& chain, float worldScale, float distance, unsigned int current) const {
+	float scale = worldScale * pixelsPerUnit;
+	if (perspective) {
+		scale /= std::max(distance, 0.1f);
+	}
+
+	//Errors grow along the chain, so walk from the coarsest level and stop at the first one that is fine enough
+	for (unsigned int level = chain.size() - 1; level > 0; level--) {
+		float limit = level > current ? threshold * HYSTERESIS : threshold;
+		if (chain.errors[level] * scale <= limit) {
+			return level;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <vector>
+
+#include "meshRegistry.h"
+
+//Versions of one shape from finest to coarsest, each with its geometric error in the shape's local units
+struct LodChain {
+	std::vector<MeshHandle> meshes;
+	std::vector<float> errors; //Largest distance between a level's surface and the true shape
+	std::vector<unsigned int> triangles;
+
+	void add(MeshHandle mesh, float error, unsigned int triangleCount);
+	unsigned int size() const { return (unsigned int)meshes.size(); }
+};
+
+//Deviation of an n sided polygon from the circle it approximates, the chord error of each segment
+float chordError(float radius, int segments);
+
+//Picks the coarsest level whose error, projected to the screen, stays under a pixel threshold
+class LodSelector
+{
+public:
+	//A coarser level than the current one must be this much under the threshold, so objects sitting on a
+	//switching distance do not flip between two levels every frame
+	static const float HYSTERESIS;
+
+	LodSelector();
+
+	void setThreshold(float pixels) { threshold = pixels; }
+	float getThreshold() const { return threshold; }
+
+	//Pixels covered by one world unit one unit away from a perspective camera
+	void setPerspective(float viewportHeight, float fovY);
+	//Pixels covered by one world unit at any distance from an orthographic camera
+	void setOrthographic(float viewportHeight, float viewHeight);
+
+	unsigned int select(const LodChain& chain, float worldScale, float distance, unsigned int current) const;
+
+private:
+	float threshold;
+	float pixelsPerUnit;
+	bool perspective;
+};
@@ -0,0 +1,171 @@
+#include "logger.h"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+Logger logger;
+
+namespace {
+	const char* categoryNames[LOG_CATEGORY_COUNT] = { "input", "scene", "render" };
+	const char* levelNames[] = { "debug", "info", "warning", "error", "off" };
+
+	//How long the writer sleeps between batches, short enough that messages still read as immediate
+	const chrono::milliseconds writerInterval(10);
+
+	//Which of the logger's rings this thread writes to, -1 until it first logs
+	thread_local int producerSlot = -1;
+}
+
+Logger::Logger() : producers(0), unclaimed(0), droppedReported(0), stopping(false) {
+	setLevel(LOG_INFO);
+}
+
+Logger::~Logger() {
+	stop();
+}
+
+void Logger::start() {
+	stop();
+	stopping = false;
+	writer = thread(&Logger::writerLoop, this);
+}
+
+void Logger::stop() {
+	if (!writer.joinable()) {
+		return;
+	}
+	{
+		lock_guard<mutex> lock(writerMutex);
+		stopping = true;
+	}
+	writerWake.notify_all();
+	writer.join();
+}
+
+void Logger::setLevel(LogLevel level) {
+	for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+		setLevel((LogCategory)i, level);
+	}
+}
+
+bool Logger::parseFilter(const string& filter) {
+	size_t equals = filter.find('=');
+	if (equals == string::npos) {
+		return false;
+	}
+	string category = filter.substr(0, equals);
+	string level = filter.substr(equals + 1);
+
+	int levelIndex = -1;
+	for (int i = 0; i <= LOG_OFF; i++) {
+		if (level == levelNames[i]) {
+			levelIndex = i;
+		}
+	}
+	if (levelIndex < 0) {
+		return false;
+	}
+
+	if (category == "all") {
+		setLevel((LogLevel)levelIndex);
+		return true;
+	}
+	for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+		if (category == categoryNames[i]) {
+			setLevel((LogCategory)i, (LogLevel)levelIndex);
+			return true;
+		}
+	}
+	return false;
+}
+
+void Logger::record(LogCategory category, LogLevel level, const char* text, unsigned char argCount,
+	double a, double b, double c, double d) {
+	RecordRing* ring = threadRing();
+	if (ring == NULL) {
+		unclaimed.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	LogRecord entry;
+	entry.text = text;
+	entry.args[0] = a;
+	entry.args[1] = b;
+	entry.args[2] = c;
+	entry.args[3] = d;
+	entry.category = (unsigned char)category;
+	entry.level = (unsigned char)level;
+	entry.argCount = argCount;
+
+	//A full ring drops the message rather than make the caller wait for the writer
+	ring->push(entry);
+}
+
+Logger::RecordRing* Logger::threadRing() {
+	if (producerSlot < 0) {
+		producerSlot = (int)producers.fetch_add(1, memory_order_relaxed);
+	}
+	return producerSlot < (int)MAX_PRODUCERS ? &rings[producerSlot] : NULL;
+}
+
+void Logger::writerLoop() {
+	string text;
+	bool finished = false;
+	while (!finished) {
+		{
+			unique_lock<mutex> lock(writerMutex);
+			writerWake.wait_for(lock, writerInterval, [this] { return stopping; });
+			finished = stopping;
+		}
+
+		//One write and one flush for the whole batch
+		text.clear();
+		drain(text);
+		if (!text.empty()) {
+			cout.write(text.data(), text.size());
+			cout.flush();
+		}
+	}
+}
+
+void Logger::drain(string& text) {
+	ostringstream line;
+	LogRecord entry;
+	for (unsigned int i = 0; i < MAX_PRODUCERS; i++) {
+		while (rings[i].pop(entry)) {
+			line.str("");
+			line << "[" << categoryNames[entry.category];
+			if (entry.level != LOG_INFO) {
+				line << " " << levelNames[entry.level];
+			}
+			line << "] ";
+
+			unsigned int arg = 0;
+			for (const char* c = entry.text; *c != '\0'; c++) {
+				if (c[0] == '{' && c[1] == '}' && arg < entry.argCount) {
+					line << entry.args[arg++];
+					c++;
+				}
+				else {
+					line << *c;
+				}
+			}
+			line << "\n";
+			text += line.str();
+		}
+	}
+
+	unsigned int dropped = unclaimed.load(memory_order_relaxed);
+	for (unsigned int i = 0; i < MAX_PRODUCERS; i++) {
+		dropped += rings[i].getDropped();
+	}
+	if (dropped != droppedReported) {
+		line.str("");
+		line << "[log warning] " << dropped - droppedReported << " messages dropped\n";
+		text += line.str();
+		droppedReported = dropped;
+	}
+}
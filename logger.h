@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "spscRing.h"
+
+enum LogCategory {
+	LOG_INPUT,
+	LOG_SCENE,
+	LOG_RENDER,
+	LOG_CATEGORY_COUNT
+};
+
+enum LogLevel {
+	LOG_DEBUG,
+	LOG_INFO,
+	LOG_WARNING,
+	LOG_ERROR,
+	LOG_OFF //Only used as a filter, hides every message of the category
+};
+
+//One message as it crosses from the logging thread to the writer, formatted only on the writer
+struct LogRecord {
+	static const unsigned int MAX_ARGS = 4;
+
+	const char* text; //Must be a string literal, each {} is replaced by the next argument
+	double args[MAX_ARGS];
+	unsigned char category;
+	unsigned char level;
+	unsigned char argCount;
+};
+
+//Messages are copied as fixed size records into a lock-free ring owned by the calling thread, a background
+//thread turns them into text and flushes them in batches, so no caller ever waits on the terminal.
+//A message below its category's level costs one comparison and is never recorded
+class Logger
+{
+public:
+	static const unsigned int MAX_PRODUCERS = 4; //Threads that may log, any after these lose their messages
+	static const unsigned int RING_SIZE = 1024; //Records each thread can have waiting for the writer
+
+	Logger();
+	~Logger();
+
+	void start();
+	void stop(); //Writes out everything already recorded
+
+	void setLevel(LogCategory category, LogLevel level) { levels[category].store((unsigned char)level, std::memory_order_relaxed); }
+	void setLevel(LogLevel level); //Every category
+	//Reads a filter such as "input=debug" or "all=warning", false when it names an unknown category or level
+	bool parseFilter(const std::string& filter);
+
+	bool enabled(LogCategory category, LogLevel level) const {
+		return (unsigned char)level >= levels[category].load(std::memory_order_relaxed);
+	}
+
+	void log(LogCategory category, LogLevel level, const char* text) {
+		if (enabled(category, level)) {
+			record(category, level, text, 0, 0.0, 0.0, 0.0, 0.0);
+		}
+	}
+	void log(LogCategory category, LogLevel level, const char* text, double a) {
+		if (enabled(category, level)) {
+			record(category, level, text, 1, a, 0.0, 0.0, 0.0);
+		}
+	}
+	void log(LogCategory category, LogLevel level, const char* text, double a, double b) {
+		if (enabled(category, level)) {
+			record(category, level, text, 2, a, b, 0.0, 0.0);
+		}
+	}
+	void log(LogCategory category, LogLevel level, const char* text, double a, double b, double c) {
+		if (enabled(category, level)) {
+			record(category, level, text, 3, a, b, c, 0.0);
+		}
+	}
+
+private:
+	typedef SpscRing<LogRecord, RING_SIZE> RecordRing;
+
+	void record(LogCategory category, LogLevel level, const char* text, unsigned char argCount,
+		double a, double b, double c, double d);
+	RecordRing* threadRing(); //The calling thread's ring, NULL once every ring is taken
+	void writerLoop();
+	void drain(std::string& text); //Formats every waiting record onto text
+
+	std::atomic<unsigned char> levels[LOG_CATEGORY_COUNT];
+	RecordRing rings[MAX_PRODUCERS];
+	std::atomic<unsigned int> producers; //Rings handed out so far
+	std::atomic<unsigned int> unclaimed; //Messages from threads that found no free ring
+	unsigned int droppedReported;
+
+	std::thread writer;
+	std::mutex writerMutex;
+	std::condition_variable writerWake; //Only signalled by stop, the writer otherwise wakes on a timer
+	bool stopping;
+};
+
+extern Logger logger;
@@ -0,0 +1,150 @@
+#include "meshRegistry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace {
+	MeshBounds computeBounds(const std::vector<Vertex>& vertices) {
+		MeshBounds result;
+		result.min = result.max = vertices.empty() ? glm::vec3(0.0f) : vertices[0].position;
+		for (std::size_t i = 1; i < vertices.size(); i++) {
+			result.min = glm::min(result.min, vertices[i].position);
+			result.max = glm::max(result.max, vertices[i].position);
+		}
+
+		//Sphere around the box center, tighter than the box's own corner distance for round shapes
+		result.center = (result.min + result.max) * 0.5f;
+		float radiusSquared = 0.0f;
+		for (std::size_t i = 0; i < vertices.size(); i++) {
+			glm::vec3 offset = vertices[i].position - result.center;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+		result.radius = std::sqrt(radiusSquared);
+		return result;
+	}
+
+	//Splits the mesh so no two triangles share a vertex and places triangle t in cell t of the lightmap grid
+	MeshData unwrapLightmap(const MeshData& mesh) {
+		const glm::vec2 corners[3] = {
+			glm::vec2(LIGHTMAP_CELL_MARGIN, LIGHTMAP_CELL_MARGIN),
+			glm::vec2(1.0f - LIGHTMAP_CELL_MARGIN, LIGHTMAP_CELL_MARGIN),
+			glm::vec2(LIGHTMAP_CELL_MARGIN, 1.0f - LIGHTMAP_CELL_MARGIN)
+		};
+
+		MeshData result;
+		unsigned int triangleCount = (unsigned int)(mesh.indices.size() / 3);
+		unsigned int cellsPerRow = lightmapCellsPerRow(triangleCount);
+		for (unsigned int t = 0; t < triangleCount; t++) {
+			glm::vec2 cell((float)(t % cellsPerRow), (float)(t / cellsPerRow));
+			for (unsigned int corner = 0; corner < 3; corner++) {
+				Vertex vertex = mesh.vertices[mesh.indices[t * 3 + corner]];
+				vertex.lightmapCoord = cell + corners[corner];
+				result.indices.push_back((GLuint)result.vertices.size());
+				result.vertices.push_back(vertex);
+			}
+		}
+		return result;
+	}
+}
+
+unsigned int lightmapCellsPerRow(unsigned int triangleCount) {
+	return std::max(1u, (unsigned int)std::ceil(std::sqrt((float)triangleCount)));
+}
+
+MeshRegistry::MeshRegistry() : vao(0), vertexBuffer(0), indexBuffer(0), lightmapped(false) {
+}
+
+MeshHandle MeshRegistry::add(const MeshData& source) {
+	const MeshData* added = &source;
+	MeshData unwrapped;
+	if (lightmapped) {
+		unwrapped = unwrapLightmap(source);
+		added = &unwrapped;
+	}
+	const MeshData& mesh = *added;
+
+	MeshRange range;
+	range.firstIndex = (GLuint)stagedIndices.size();
+	range.indexCount = (GLuint)mesh.indices.size();
+	range.baseVertex = (GLint)stagedVertices.size();
+
+	//Indices stay relative to the mesh, baseVertex moves them to the right place in the shared buffer
+	stagedVertices.insert(stagedVertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+	stagedIndices.insert(stagedIndices.end(), mesh.indices.begin(), mesh.indices.end());
+
+	ranges.push_back(range);
+	bounds.push_back(computeBounds(mesh.vertices));
+	if (lightmapped) {
+		geometry.push_back(mesh);
+	}
+	return (MeshHandle)(ranges.size() - 1);
+}
+
+MeshHandle MeshRegistry::add(const Sphere& sphere) {
+	//Sphere data is interleaved as position, normal, texture coordinate
+	MeshData mesh;
+	const float* interleaved = sphere.getInterleavedVertices();
+	unsigned int floatCount = sphere.getInterleavedVertexSize() / sizeof(float);
+	for (unsigned int i = 0; i + 8 <= floatCount; i += 8) {
+		Vertex vertex;
+		vertex.position = glm::vec3(interleaved[i], interleaved[i + 1], interleaved[i + 2]);
+		vertex.normal = glm::vec3(interleaved[i + 3], interleaved[i + 4], interleaved[i + 5]);
+		vertex.texCoord = glm::vec2(interleaved[i + 6], interleaved[i + 7]);
+		mesh.vertices.push_back(vertex);
+	}
+	mesh.indices.assign(sphere.getIndices(), sphere.getIndices() + sphere.getIndexCount());
+
+	return add(mesh);
+}
+
+void MeshRegistry::upload() {
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, stagedVertices.size() * sizeof(Vertex), stagedVertices.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, stagedIndices.size() * sizeof(GLuint), stagedIndices.data(), GL_STATIC_DRAW);
+
+	GLint stride = sizeof(Vertex);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, position));
+	glEnableVertexAttribArray(0);
+
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, texCoord));
+	glEnableVertexAttribArray(1);
+
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, normal));
+	glEnableVertexAttribArray(2);
+
+	glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, lightmapCoord));
+	glEnableVertexAttribArray(4);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	//The GPU copy is all render() needs from here on
+	std::vector<Vertex>().swap(stagedVertices);
+	std::vector<GLuint>().swap(stagedIndices);
+}
+
+void MeshRegistry::attachInstances(const InstanceBuffer& instances) {
+	attachInstanceAttributes(vao, instances.getIdBuffer());
+}
+
+void MeshRegistry::destroy() {
+	if (vao != 0) {
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &vertexBuffer);
+		glDeleteBuffers(1, &indexBuffer);
+		vao = vertexBuffer = indexBuffer = 0;
+	}
+	ranges.clear();
+	bounds.clear();
+	geometry.clear();
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+
+//GLM Math headers
+#include <glm/glm.hpp>
+
+//Sphere header
+#include "sphere.h"
+
+//Instancing header
+#include "instancing.h"
+
+//Unified vertex layout shared by every static mesh, in shader attribute order
+struct Vertex {
+	glm::vec3 position; //Attribute location 0
+	glm::vec2 texCoord; //Attribute location 1
+	glm::vec3 normal; //Attribute location 2
+	glm::vec2 lightmapCoord; //Attribute location 4, in lightmap cells. Location 3 is the draw ID
+};
+
+//CPU side geometry produced by the build functions, handed to the registry before upload
+struct MeshData {
+	std::vector<Vertex> vertices;
+	std::vector<GLuint> indices;
+};
+
+//Lightmapped meshes give every triangle a cell of its own in a square grid this many cells wide
+unsigned int lightmapCellsPerRow(unsigned int triangleCount);
+
+//Corners of a triangle's cell the triangle covers, in cell units: (margin, margin), (1 - margin, margin), (margin, 1 - margin).
+//The margin keeps bilinear filtering from reading the neighboring cell
+const float LIGHTMAP_CELL_MARGIN = 0.1f;
+
+//Stable handle to a mesh inside the shared buffers
+typedef unsigned int MeshHandle;
+
+//Where a mesh lives inside the shared vertex and index buffers
+struct MeshRange {
+	GLuint firstIndex;
+	GLuint indexCount;
+	GLint baseVertex;
+};
+
+//Local space bounds of a mesh, computed once when it is added
+struct MeshBounds {
+	glm::vec3 min;
+	glm::vec3 max;
+	glm::vec3 center; //Center of the box, also the center of the sphere
+	float radius; //Distance from center to the farthest vertex
+};
+
+//Packs every static mesh into one vertex buffer and one index buffer behind a single VAO
+class MeshRegistry
+{
+public:
+	MeshRegistry();
+
+	MeshHandle add(const MeshData& mesh); //Appends the mesh to the staging data
+	MeshHandle add(const Sphere& sphere); //Converts the interleaved sphere data to the unified layout
+
+	//Meshes added while enabled get one vertex per triangle corner and lightmap coordinates, and their geometry stays on the CPU
+	//for the lightmap baker
+	void setLightmapped(bool enabled) { lightmapped = enabled; }
+	const MeshData* getGeometry(MeshHandle handle) const { return lightmapped ? &geometry[handle] : NULL; }
+
+	void upload(); //Creates the shared VAO and buffers from everything added so far, exactly once
+	void attachInstances(const InstanceBuffer& instances); //Wires the per-instance draw ID into the shared VAO
+	void destroy(); //Deletes the VAO and buffers
+
+	void bind() const { glBindVertexArray(vao); }
+	const MeshRange& getRange(MeshHandle handle) const { return ranges[handle]; }
+	const MeshBounds& getBounds(MeshHandle handle) const { return bounds[handle]; }
+	unsigned int size() const { return (unsigned int)ranges.size(); }
+
+private:
+	GLuint vao;
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+	std::vector<MeshRange> ranges;
+	std::vector<MeshBounds> bounds;
+	std::vector<Vertex> stagedVertices;
+	std::vector<GLuint> stagedIndices;
+	bool lightmapped;
+	std::vector<MeshData> geometry; //Lightmapped meshes as they were uploaded
+};
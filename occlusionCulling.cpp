@@ -0,0 +1,99 @@
+#include "occlusionCulling.h"
+
+OcclusionCuller::OcclusionCuller() : program(0), boxMinLocation(-1), boxMaxLocation(-1), cubeMesh(0), frame(1), occluded(0), queriesIssued(0) {
+}
+
+void OcclusionCuller::create(const ShaderProgram& proxyProgram, MeshHandle cube) {
+	program = &proxyProgram;
+	boxMinLocation = proxyProgram.uniform("boxMin");
+	boxMaxLocation = proxyProgram.uniform("boxMax");
+	cubeMesh = cube;
+}
+
+void OcclusionCuller::destroy() {
+	if (!queries.empty()) {
+		glDeleteQueries((GLsizei)queries.size(), queries.data());
+	}
+	queries.clear();
+	issuedFrame.clear();
+}
+
+void OcclusionCuller::resize(unsigned int objectCount) {
+	destroy();
+	queries.resize(objectCount * 2);
+	issuedFrame.assign(objectCount * 2, 0);
+	if (!queries.empty()) {
+		glGenQueries((GLsizei)queries.size(), queries.data());
+	}
+}
+
+void OcclusionCuller::beginFrame() {
+	frame++;
+	queriesIssued = 0;
+
+	//Results still in flight are left alone and count as visible
+	occluded = 0;
+	unsigned int last = (frame - 1) & 1;
+	for (std::size_t object = 0; object * 2 < queries.size(); object++) {
+		std::size_t index = object * 2 + last;
+		if (issuedFrame[index] != frame - 1) {
+			continue;
+		}
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available == GL_TRUE) {
+			GLuint anySamples = GL_TRUE;
+			glGetQueryObjectuiv(queries[index], GL_QUERY_RESULT, &anySamples);
+			if (anySamples == GL_FALSE) {
+				occluded++;
+			}
+		}
+	}
+}
+
+GLuint OcclusionCuller::conditionFor(unsigned int object) const {
+	std::size_t index = object * 2 + ((frame - 1) & 1);
+	if (index >= queries.size() || issuedFrame[index] != frame - 1) {
+		return 0;
+	}
+	return queries[index];
+}
+
+void OcclusionCuller::drawProxies(const std::vector<unsigned int>& objects, const std::vector<Aabb>& boxes, const MeshRegistry& meshes, const glm::vec3& eye) {
+	if (objects.empty()) {
+		return;
+	}
+
+	//Boxes only have to reach the depth test, nothing they cover is written
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	program->use();
+	meshes.bind();
+
+	const MeshRange& range = meshes.getRange(cubeMesh);
+	unsigned int current = frame & 1;
+	for (std::size_t i = 0; i < objects.size(); i++) {
+		unsigned int object = objects[i];
+		const Aabb& box = boxes[i];
+		bool eyeInside = eye.x >= box.min.x && eye.y >= box.min.y && eye.z >= box.min.z &&
+			eye.x <= box.max.x && eye.y <= box.max.y && eye.z <= box.max.z;
+		if (eyeInside) {
+			continue;
+		}
+
+		program->setVec3(boxMinLocation, box.min);
+		program->setVec3(boxMaxLocation, box.max);
+
+		std::size_t index = object * 2 + current;
+		glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, queries[index]);
+		glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (void*)(range.firstIndex * sizeof(GLuint)), range.baseVertex);
+		glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+		issuedFrame[index] = frame;
+		queriesIssued++;
+	}
+
+	glBindVertexArray(0);
+	glUseProgram(0);
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
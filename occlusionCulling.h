@@ -0,0 +1,49 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+
+//GLM Math headers
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "meshRegistry.h"
+#include "shaderProgram.h"
+
+//Tests objects against the depth buffer by drawing their bounding boxes inside occlusion queries.
+//Each object owns two queries: the one issued this frame, and last frame's, which conditional rendering
+//uses to skip the real draw. The CPU only reads results that are already available, so it never waits
+class OcclusionCuller
+{
+public:
+	OcclusionCuller();
+
+	//proxyProgram draws a box from its boxMin and boxMax uniforms, cube is a unit cube centered on the origin
+	void create(const ShaderProgram& proxyProgram, MeshHandle cube);
+	void destroy();
+	void resize(unsigned int objectCount);
+
+	//Swaps this frame's and last frame's queries and counts last frame's results that have arrived
+	void beginFrame();
+
+	//Last frame's query for the object, or 0 when it was not tested last frame and has to be drawn
+	GLuint conditionFor(unsigned int object) const;
+
+	//Draws the box of every tested object with color and depth writes off, after the scene is drawn.
+	//boxes[i] is the world box of objects[i]. Boxes around the camera are skipped, their back faces would be hidden by the object itself
+	void drawProxies(const std::vector<unsigned int>& objects, const std::vector<Aabb>& boxes, const MeshRegistry& meshes, const glm::vec3& eye);
+
+	unsigned int getOccluded() const { return occluded; } //Objects last frame's queries found hidden
+	unsigned int getQueries() const { return queriesIssued; } //Proxies drawn this frame
+
+private:
+	const ShaderProgram* program;
+	GLint boxMinLocation;
+	GLint boxMaxLocation;
+	MeshHandle cubeMesh;
+
+	std::vector<GLuint> queries; //Two per object, indexed object * 2 + parity
+	std::vector<unsigned int> issuedFrame; //Frame each query was last issued in, same indexing
+	unsigned int frame;
+	unsigned int occluded;
+	unsigned int queriesIssued;
+};
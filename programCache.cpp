@@ -0,0 +1,143 @@
+#include "programCache.h"
+
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+using namespace std;
+
+namespace {
+	const char cacheMagic[4] = { 'D', 'S', 'K', 'P' };
+	const uint32_t cacheVersion = 1;
+
+	struct ProgramCacheHeader {
+		char magic[4];
+		uint32_t version;
+		ProgramKey key;
+		uint32_t format; //Driver specific, passed back to glProgramBinary as is
+		uint32_t length;
+	};
+
+	//64 bit FNV-1a, continued from hash so several strings can be chained
+	ProgramKey fnv1a(ProgramKey hash, const char* text) {
+		const ProgramKey prime = 1099511628211ULL;
+		for (const unsigned char* c = (const unsigned char*)text; *c != 0; c++) {
+			hash = (hash ^ *c) * prime;
+		}
+		//The terminator keeps "ab" + "c" apart from "a" + "bc"
+		return hash * prime;
+	}
+
+	const ProgramKey fnvOffset = 14695981039346656037ULL;
+
+	const char* glString(GLenum name) {
+		const GLubyte* value = glGetString(name);
+		return value != NULL ? (const char*)value : "";
+	}
+
+	void makeDirectory(const string& path) {
+#ifdef _WIN32
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+}
+
+ProgramCache::ProgramCache() : enabled(false), driverHash(fnvOffset) {
+}
+
+bool ProgramCache::open(const string& cacheDirectory) {
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if (formats == 0) {
+		cout << "Program binary cache disabled, the driver offers no binary formats" << endl;
+		enabled = false;
+		return false;
+	}
+
+	directory = cacheDirectory;
+	makeDirectory(directory);
+	driverHash = fnv1a(fnv1a(fnv1a(fnvOffset, glString(GL_VENDOR)), glString(GL_RENDERER)), glString(GL_VERSION));
+	enabled = true;
+	return true;
+}
+
+ProgramKey ProgramCache::key(const char* vertShaderSource, const char* fragShaderSource) const {
+	return fnv1a(fnv1a(driverHash, vertShaderSource), fragShaderSource);
+}
+
+bool ProgramCache::load(const string& programName, ProgramKey programKey, GLuint programID) const {
+	if (!enabled) {
+		return false;
+	}
+	ifstream file(pathFor(programName).c_str(), ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	ProgramCacheHeader header;
+	file.read((char*)&header, sizeof(header));
+	if (!file || memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion || header.key != programKey) {
+		return false;
+	}
+	vector<char> binary(header.length);
+	file.read(binary.data(), binary.size());
+	if (!file) {
+		return false;
+	}
+
+	//Drivers may still refuse a binary with a matching key, say after an update that kept the version string
+	glProgramBinary(programID, (GLenum)header.format, binary.data(), (GLsizei)binary.size());
+	GLint linked = GL_FALSE;
+	glGetProgramiv(programID, GL_LINK_STATUS, &linked);
+	return linked == GL_TRUE;
+}
+
+bool ProgramCache::save(const string& programName, ProgramKey programKey, GLuint programID) const {
+	if (!enabled) {
+		return false;
+	}
+	GLint length = 0;
+	glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return false;
+	}
+
+	ProgramCacheHeader header;
+	memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+	header.version = cacheVersion;
+	header.key = programKey;
+	vector<char> binary(length);
+	GLenum format = GL_NONE;
+	GLsizei written = 0;
+	glGetProgramBinary(programID, length, &written, &format, binary.data());
+	header.format = format;
+	header.length = (uint32_t)written;
+
+	ofstream file(pathFor(programName).c_str(), ios::binary | ios::trunc);
+	if (!file) {
+		return false;
+	}
+	file.write((const char*)&header, sizeof(header));
+	file.write(binary.data(), written);
+	return (bool)file;
+}
+
+string ProgramCache::pathFor(const string& programName) const {
+	//Program names are free text, keep the file name to characters every file system accepts
+	string fileName(programName);
+	for (size_t i = 0; i < fileName.size(); i++) {
+		if (!isalnum((unsigned char)fileName[i])) {
+			fileName[i] = '_';
+		}
+	}
+	return directory + "/" + fileName + ".bin";
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <string>
+
+//Identifies one program as built by one driver: a hash of its stage sources, defines included, and the driver's strings
+typedef std::uint64_t ProgramKey;
+
+//Linked program binaries saved with glGetProgramBinary, one file per program name. A file is only used when the key
+//stored in it matches, so an edited shader or an updated driver falls back to compiling from source and replaces it
+class ProgramCache
+{
+public:
+	ProgramCache();
+
+	//Needs a current context, false when the driver offers no binary formats and the cache stays disabled
+	bool open(const std::string& cacheDirectory);
+	bool isOpen() const { return enabled; }
+
+	ProgramKey key(const char* vertShaderSource, const char* fragShaderSource) const;
+
+	//Hands the saved binary to glProgramBinary, false when there is none, its key differs, or the driver rejects it
+	bool load(const std::string& programName, ProgramKey programKey, GLuint programID) const;
+	//programID must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+	bool save(const std::string& programName, ProgramKey programKey, GLuint programID) const;
+
+private:
+	std::string pathFor(const std::string& programName) const;
+
+	bool enabled;
+	std::string directory;
+	ProgramKey driverHash; //GL_VENDOR, GL_RENDERER and GL_VERSION, a binary only loads on the driver that wrote it
+};
@@ -0,0 +1,270 @@
+#include "renderQueue.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	bool keyLess(const RenderItem& a, const RenderItem& b) {
+		return a.key < b.key;
+	}
+
+	//Non-negative floats keep their order when their bits are compared as unsigned integers,
+	//dropping low mantissa bits only merges depths closer than about a thousandth of each other
+	unsigned long long depthBits(float depth) {
+		if (!(depth > 0.0f)) {
+			return 0;
+		}
+		unsigned int bits;
+		std::memcpy(&bits, &depth, sizeof(bits));
+		return bits >> (32 - RenderQueue::DEPTH_BITS);
+	}
+
+	bool checkRange(const char* name, std::size_t count, int bits) {
+		if (count > (1ULL << bits)) {
+			std::cerr << "Render queue: " << count << " " << name << " registered, the sort key holds " << (1ULL << bits) << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	const unsigned long long stateMask = ~((1ULL << RenderQueue::DEPTH_BITS) - 1);
+}
+
+float viewDepth(const glm::mat4& view, const glm::mat4& model) {
+	glm::vec4 viewPosition = view * model[3];
+	return -viewPosition.z;
+}
+
+RenderQueue::RenderQueue() : itemsSorted(true), commandBuffer(0), commandOffset(0), stats(), dropReported(false) {
+}
+
+ProgramSlot RenderQueue::addProgram(const ShaderProgram& program) {
+	programs.push_back(&program);
+	return (ProgramSlot)(programs.size() - 1);
+}
+
+bool RenderQueue::checkKeyRanges(unsigned int meshCount) const {
+	bool programsFit = checkRange("programs", programs.size(), PROGRAM_BITS);
+	bool texturesFit = checkRange("texture arrays", textures.size(), TEXTURE_BITS);
+	return checkRange("meshes", meshCount, MESH_BITS) && programsFit && texturesFit;
+}
+
+TextureSlot RenderQueue::addTexture(GLuint arrayTexture, GLuint layer) {
+	TextureSlotInfo slot;
+	slot.array = (unsigned int)(std::find(textures.begin(), textures.end(), arrayTexture) - textures.begin());
+	if (slot.array == textures.size()) {
+		textures.push_back(arrayTexture);
+	}
+	slot.layer = layer;
+	textureSlots.push_back(slot);
+	return (TextureSlot)(textureSlots.size() - 1);
+}
+
+void RenderQueue::submit(ProgramSlot program, MeshHandle mesh, TextureSlot texture, const glm::mat4& model, const glm::mat3& normal,
+	float depth, const glm::vec4& tint, GLuint condition) {
+	items.push_back(makeItem(program, mesh, texture, model, normal, depth, tint, condition));
+	itemsSorted = false;
+}
+
+RenderItem RenderQueue::makeItem(ProgramSlot program, MeshHandle mesh, TextureSlot texture, const glm::mat4& model, const glm::mat3& normal,
+	float depth, const glm::vec4& tint, GLuint condition) const {
+	assert(program < (1u << PROGRAM_BITS) && textureSlots[texture].array < (1u << TEXTURE_BITS) && mesh < (1u << MESH_BITS));
+	RenderItem item;
+	item.key = ((unsigned long long)program << (TEXTURE_BITS + MESH_BITS + DEPTH_BITS)) |
+		((unsigned long long)textureSlots[texture].array << (MESH_BITS + DEPTH_BITS)) |
+		((unsigned long long)mesh << DEPTH_BITS) |
+		depthBits(depth);
+	item.mesh = mesh;
+	item.program = program;
+	item.texture = texture;
+	item.model = model;
+	item.normal = normal;
+	item.tint = tint;
+	item.condition = condition;
+	item.occludee = NO_OCCLUDEE;
+	item.lightmap = 0;
+	return item;
+}
+
+void RenderQueue::sortList(RenderList& list) {
+	std::sort(list.begin(), list.end(), keyLess);
+}
+
+void RenderQueue::mergeLists(const std::vector<RenderList>& lists, RenderList& items) {
+	//Merge neighbouring sorted runs pairwise until one run is left
+	items.clear();
+	std::vector<std::size_t> runs(1, 0);
+	for (std::size_t i = 0; i < lists.size(); i++) {
+		if (!lists[i].empty()) {
+			items.insert(items.end(), lists[i].begin(), lists[i].end());
+			runs.push_back(items.size());
+		}
+	}
+	while (runs.size() > 2) {
+		std::vector<std::size_t> merged(1, runs[0]);
+		for (std::size_t i = 1; i + 1 < runs.size(); i += 2) {
+			std::inplace_merge(items.begin() + runs[i - 1], items.begin() + runs[i], items.begin() + runs[i + 1], keyLess);
+			merged.push_back(runs[i + 1]);
+		}
+		if (runs.size() % 2 == 0) {
+			merged.push_back(runs.back());
+		}
+		runs.swap(merged);
+	}
+}
+
+void RenderQueue::takeSorted(RenderList& list) {
+	items.swap(list);
+	itemsSorted = true;
+}
+
+void RenderQueue::flush(const MeshRegistry& meshes, InstanceBuffer& instances, RingBuffer& ring) {
+	stats = FrameStats();
+	stats.items = (unsigned int)items.size();
+	if (items.empty()) {
+		return;
+	}
+
+	if (!itemsSorted) {
+		std::sort(items.begin(), items.end(), keyLess);
+	}
+
+	//Sorted order is also instance order, so every run of equal state is a contiguous instance range
+	instances.clear();
+	for (std::size_t i = 0; i < items.size(); i++) {
+		instances.add(items[i].model, items[i].normal, items[i].tint, textureSlots[items[i].texture].layer, items[i].lightmap);
+	}
+	if (!instances.upload(ring)) {
+		dropFlush();
+		return;
+	}
+	instances.bind();
+
+	//One indirect command per run of the same mesh, one batch per run of the same program and texture array
+	commands.clear();
+	batches.clear();
+	conditional.clear();
+	std::size_t runStart = 0;
+	while (runStart < items.size()) {
+		const RenderItem& item = items[runStart];
+
+		//Conditional items need a draw call of their own to wrap in glBeginConditionalRender
+		if (item.condition != 0) {
+			conditional.push_back((unsigned int)runStart);
+			runStart++;
+			continue;
+		}
+
+		std::size_t runEnd = runStart + 1;
+		while (runEnd < items.size() && items[runEnd].condition == 0 && (items[runEnd].key & stateMask) == (item.key & stateMask)) {
+			runEnd++;
+		}
+
+		const MeshRange& range = meshes.getRange(item.mesh);
+		DrawElementsIndirectCommand command;
+		command.count = range.indexCount;
+		command.instanceCount = (GLuint)(runEnd - runStart);
+		command.firstIndex = range.firstIndex;
+		command.baseVertex = range.baseVertex;
+		command.baseInstance = (GLuint)runStart;
+
+		unsigned int array = textureSlots[item.texture].array;
+		if (batches.empty() || batches.back().program != item.program || batches.back().texture != array) {
+			Batch batch;
+			batch.program = item.program;
+			batch.texture = array;
+			batch.firstCommand = (GLuint)commands.size();
+			batch.commandCount = 0;
+			batches.push_back(batch);
+		}
+		commands.push_back(command);
+		batches.back().commandCount++;
+
+		runStart = runEnd;
+	}
+	if (!uploadCommands(ring)) {
+		dropFlush();
+		return;
+	}
+
+	//Every mesh lives in the shared buffers, so one VAO bind covers the whole frame
+	glActiveTexture(GL_TEXTURE0);
+	meshes.bind();
+	stats.vaoBinds = 1;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	for (std::size_t i = 0; i < batches.size(); i++) {
+		const Batch& batch = batches[i];
+		if (i == 0 || batches[i - 1].program != batch.program) {
+			programs[batch.program]->use();
+			stats.programBinds++;
+		}
+		if (i == 0 || batches[i - 1].texture != batch.texture) {
+			glBindTexture(GL_TEXTURE_2D_ARRAY, textures[batch.texture]);
+			stats.textureBinds++;
+		}
+
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+			(void*)(commandOffset + batch.firstCommand * sizeof(DrawElementsIndirectCommand)), batch.commandCount, 0);
+		stats.drawCalls++;
+	}
+	stats.indirectCommands = (unsigned int)commands.size();
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	//The GPU skips each of these when its query saw no samples, without the CPU waiting on the result
+	ProgramSlot boundProgram = batches.empty() ? ~0u : batches.back().program;
+	unsigned int boundTexture = batches.empty() ? ~0u : batches.back().texture;
+	for (std::size_t i = 0; i < conditional.size(); i++) {
+		const RenderItem& item = items[conditional[i]];
+		if (item.program != boundProgram) {
+			programs[item.program]->use();
+			boundProgram = item.program;
+			stats.programBinds++;
+		}
+		unsigned int array = textureSlots[item.texture].array;
+		if (array != boundTexture) {
+			glBindTexture(GL_TEXTURE_2D_ARRAY, textures[array]);
+			boundTexture = array;
+			stats.textureBinds++;
+		}
+
+		const MeshRange& range = meshes.getRange(item.mesh);
+		glBeginConditionalRender(item.condition, GL_QUERY_NO_WAIT);
+		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+			(void*)(range.firstIndex * sizeof(GLuint)), 1, range.baseVertex, conditional[i]);
+		glEndConditionalRender();
+		stats.drawCalls++;
+	}
+	stats.conditionalDraws = (unsigned int)conditional.size();
+
+	//Unsorted submission binds program, texture and VAO for every item
+	stats.bindsElided = stats.items * 3 - (stats.programBinds + stats.textureBinds + stats.vaoBinds);
+
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glUseProgram(0);
+}
+
+void RenderQueue::dropFlush() {
+	//The ring is sized for the whole scene at startup, so this is a sizing bug rather than a load spike.
+	//The frame stats keep counting it after the first report
+	stats.droppedFlushes++;
+	if (!dropReported) {
+		std::cerr << "Render queue: no ring space for " << items.size() << " items, their draws were skipped" << std::endl;
+		dropReported = true;
+	}
+}
+
+bool RenderQueue::uploadCommands(RingBuffer& ring) {
+	//Commands only need the 4 byte alignment of their members
+	RingAllocation range = ring.allocate(commands.size() * sizeof(DrawElementsIndirectCommand));
+	if (range.data == NULL) {
+		return false;
+	}
+	std::memcpy(range.data, commands.data(), range.size);
+	commandBuffer = ring.getBuffer();
+	commandOffset = range.offset;
+	return true;
+}
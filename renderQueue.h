@@ -0,0 +1,125 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+
+//GLM Math headers
+#include <glm/glm.hpp>
+
+#include "frameStats.h"
+#include "instancing.h"
+#include "meshRegistry.h"
+#include "ringBuffer.h"
+#include "shaderProgram.h"
+
+//Slot a program or texture layer was registered under
+typedef unsigned int ProgramSlot;
+typedef unsigned int TextureSlot;
+
+//One object submitted for this frame
+struct RenderItem {
+	unsigned long long key; //Program, texture array, mesh and depth packed so a plain sort groups items by state
+	MeshHandle mesh;
+	ProgramSlot program;
+	TextureSlot texture;
+	glm::mat4 model;
+	glm::mat3 normal; //Cached by the scene graph with the model matrix, so no shader inverts model
+	glm::vec4 tint;
+	GLuint condition; //Occlusion query that decides whether the item is drawn, 0 to always draw
+	unsigned int occludee; //Object whose query becomes the condition on the GL thread, NO_OCCLUDEE for none
+	GLuint lightmap; //Baked lightmap the instance samples, 0 for none
+};
+
+const unsigned int NO_OCCLUDEE = ~0u;
+
+//Items one thread built for the frame, sorted on that thread so the GL thread only merges the lists
+typedef std::vector<RenderItem> RenderList;
+
+//Layout glMultiDrawElementsIndirect reads from the draw indirect buffer
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+//Distance in front of the camera of the object a model matrix places, used for front-to-back ordering
+float viewDepth(const glm::mat4& view, const glm::mat4& model);
+
+//Collects the frame's draws, sorts them by state and issues them with as few binds and calls as possible
+class RenderQueue
+{
+public:
+	//Sort key layout, most significant first: program | texture array | mesh | depth.
+	//Depth keeps the top bits of the float, plenty for front to back order, so a scene full of LOD levels has room for meshes
+	static const int PROGRAM_BITS = 8;
+	static const int TEXTURE_BITS = 12;
+	static const int MESH_BITS = 24;
+	static const int DEPTH_BITS = 20;
+	static_assert(PROGRAM_BITS + TEXTURE_BITS + MESH_BITS + DEPTH_BITS == 64, "Sort key fields must fill 64 bits");
+
+	RenderQueue();
+
+	ProgramSlot addProgram(const ShaderProgram& program);
+	//Layers of the same array texture share a bind, the layer reaches the shader as the instance's materialID
+	TextureSlot addTexture(GLuint arrayTexture, GLuint layer = 0);
+	//False, with a message, when more programs, texture arrays or meshes are registered than their key fields hold.
+	//Overflowing one would merge unrelated items into one run, so call it once everything is registered
+	bool checkKeyRanges(unsigned int meshCount) const;
+
+	void clear() { items.clear(); itemsSorted = true; }
+	void submit(ProgramSlot program, MeshHandle mesh, TextureSlot texture, const glm::mat4& model, const glm::mat3& normal, float depth,
+		const glm::vec4& tint = glm::vec4(1.0f), GLuint condition = 0);
+
+	//Builds an item with its sort key without touching the queue, safe to call from any thread once
+	//every program and texture is registered
+	RenderItem makeItem(ProgramSlot program, MeshHandle mesh, TextureSlot texture, const glm::mat4& model, const glm::mat3& normal,
+		float depth, const glm::vec4& tint = glm::vec4(1.0f), GLuint condition = 0) const;
+	static void sortList(RenderList& list);
+
+	//Merges lists that were each sorted with sortList into one sorted list
+	static void mergeLists(const std::vector<RenderList>& lists, RenderList& merged);
+
+	//Swaps in a list sorted by mergeLists in place of the queue's items, so flush does not sort again.
+	//list is left holding the queue's previous items, ready to be reused
+	void takeSorted(RenderList& list);
+
+	//Sorts, fills the instance stream in sorted order and sends every program and texture array bucket
+	//as one glMultiDrawElementsIndirect, with one command per mesh. Items with a condition are drawn
+	//afterwards one at a time inside conditional rendering, so the unconditional ones have filled the depth buffer.
+	//Instances and indirect commands are both written into the ring's current section
+	void flush(const MeshRegistry& meshes, InstanceBuffer& instances, RingBuffer& ring);
+
+	const FrameStats& getStats() const { return stats; }
+
+private:
+	//Consecutive commands that share a program and texture array
+	struct Batch {
+		ProgramSlot program;
+		unsigned int texture; //Index into textures
+		GLuint firstCommand;
+		GLsizei commandCount;
+	};
+
+	bool uploadCommands(RingBuffer& ring);
+	void dropFlush(); //Counts a flush the ring had no room for, and reports the first one
+
+	std::vector<const ShaderProgram*> programs;
+	//Where each texture slot lives
+	struct TextureSlotInfo {
+		unsigned int array; //Index into textures
+		GLuint layer;
+	};
+
+	std::vector<GLuint> textures; //Distinct array textures, each bound once per batch
+	std::vector<TextureSlotInfo> textureSlots;
+	std::vector<RenderItem> items;
+	bool itemsSorted; //items came from takeSorted
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<Batch> batches;
+	std::vector<unsigned int> conditional; //Sorted positions of items drawn under conditional rendering
+	GLuint commandBuffer; //The ring's buffer, bound as the draw indirect buffer
+	GLintptr commandOffset; //Where this frame's commands start inside it
+	FrameStats stats;
+	bool dropReported;
+};
@@ -0,0 +1,103 @@
+#include "ringBuffer.h"
+
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+RingBuffer::RingBuffer() : buffer(0), mapped(NULL), sectionSize(0), fences(), section(0), head(0), waitMs(0.0) {
+}
+
+bool RingBuffer::create(GLsizeiptr size) {
+	if (!GLEW_ARB_buffer_storage && !GLEW_VERSION_4_4) {
+		cerr << "Ring buffer needs glBufferStorage (OpenGL 4.4 or ARB_buffer_storage)" << endl;
+		return false;
+	}
+
+	//Keep every section start aligned for any binding, 256 is the largest offset alignment drivers ask for
+	sectionSize = (size + 255) & ~(GLsizeiptr)255;
+
+	//Immutable storage that stays mapped while the GPU uses it, coherent so writes need no explicit flush
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, sectionSize * SECTIONS, NULL, flags);
+	mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, sectionSize * SECTIONS, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (mapped == NULL) {
+		cerr << "Ring buffer of " << sectionSize * SECTIONS << " bytes could not be mapped" << endl;
+		destroy();
+		return false;
+	}
+
+	section = 0;
+	head = 0;
+	return true;
+}
+
+void RingBuffer::destroy() {
+	for (int i = 0; i < SECTIONS; i++) {
+		if (fences[i] != 0) {
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+	}
+	if (buffer != 0) {
+		//Deleting a buffer unmaps it
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+	mapped = NULL;
+	sectionSize = 0;
+}
+
+void RingBuffer::beginFrame() {
+	section = (section + 1) % SECTIONS;
+	head = 0;
+	waitMs = 0.0;
+
+	GLsync fence = fences[section];
+	if (fence == 0) {
+		return;
+	}
+
+	//Normally the fence signalled frames ago and the first check returns at once.
+	//Flushing on the first wait makes sure the fence itself reaches the GPU
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (true) {
+		GLenum result = glClientWaitSync(fence, waitFlags, 1000000);
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+			break;
+		}
+		if (result == GL_WAIT_FAILED) {
+			cerr << "Ring buffer fence wait failed" << endl;
+			break;
+		}
+		waitFlags = 0;
+	}
+	waitMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	glDeleteSync(fence);
+	fences[section] = 0;
+}
+
+void RingBuffer::endFrame() {
+	fences[section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+RingAllocation RingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment) {
+	RingAllocation allocation = {};
+	GLsizeiptr start = (head + alignment - 1) & ~(alignment - 1);
+	if (mapped == NULL || start + size > sectionSize) {
+		cerr << "Ring buffer section of " << sectionSize << " bytes cannot fit another " << size << " bytes" << endl;
+		return allocation;
+	}
+
+	allocation.offset = section * sectionSize + start;
+	allocation.data = mapped + allocation.offset;
+	allocation.size = size;
+	head = start + size;
+	return allocation;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <GL/glew.h>
+
+//Space handed out for one frame: where the CPU writes it and where the GPU reads it
+struct RingAllocation {
+	void* data; //Mapped pointer, NULL when the frame's section is full
+	GLintptr offset; //Offset into the ring's buffer to bind or draw from
+	GLsizeiptr size;
+};
+
+//One buffer split into SECTIONS equal parts, persistently and coherently mapped for the lifetime of the context.
+//Each frame bump-allocates from its own section, and a fence placed after the frame's last draw
+//guards the section until the GPU has finished reading it, so writes never overwrite data still in flight
+class RingBuffer
+{
+public:
+	static const int SECTIONS = 3;
+
+	RingBuffer();
+
+	bool create(GLsizeiptr sectionSize); //Reports and returns false when the context has no glBufferStorage
+	void destroy();
+
+	//Moves to the next section, waiting only if the GPU is still reading it from SECTIONS frames ago
+	void beginFrame();
+	//Fences the current section after the last command that reads from it
+	void endFrame();
+
+	//alignment must be a power of two, such as GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT for storage ranges
+	RingAllocation allocate(GLsizeiptr size, GLsizeiptr alignment = 4);
+
+	GLuint getBuffer() const { return buffer; }
+	GLsizeiptr getUsed() const { return head; } //Bytes allocated from the current section
+	double getWaitMs() const { return waitMs; } //Time beginFrame spent waiting on the section's fence
+
+private:
+	GLuint buffer;
+	unsigned char* mapped;
+	GLsizeiptr sectionSize;
+	GLsync fences[SECTIONS];
+	int section;
+	GLsizeiptr head;
+	double waitMs;
+};
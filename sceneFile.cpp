@@ -0,0 +1,420 @@
+#include "sceneFile.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+	const char sceneMagic[4] = { 'D', 'S', 'K', 'S' };
+	const uint32_t sceneVersion = 1;
+
+	struct ShapeName {
+		const char* name;
+		SceneShape shape;
+		int paramCount;
+		float defaults[SCENE_MESH_PARAMS];
+		float minimums[SCENE_MESH_PARAMS]; //Smallest value each parameter accepts, fewer segments than this divide by zero
+	};
+
+	//Upper bounds well past anything drawable, and small enough that counts still fit in an int
+	const float maxTessellation = 1000000.0f;
+	const float maxRadius = 1000000.0f;
+
+	//Tessellation parameters per shape, their defaults when a scene leaves them out, and their smallest valid values
+	const ShapeName shapeNames[] = {
+		{ "cube", SHAPE_CUBE, 0, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+		{ "cylinder", SHAPE_CYLINDER, 1, { 7000.0f, 0.0f, 0.0f }, { 3.0f, 0.0f, 0.0f } }, //segments
+		{ "torus", SHAPE_TORUS, 2, { 10.0f, 100.0f, 0.0f }, { 3.0f, 3.0f, 0.0f } }, //segments, slices
+		{ "plane", SHAPE_PLANE, 0, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+		{ "pyramid", SHAPE_PYRAMID, 0, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+		{ "sphere", SHAPE_SPHERE, 3, { 1.0f, 36.0f, 18.0f }, { 0.001f, 3.0f, 2.0f } } //radius, sectors, stacks
+	};
+
+	//The sphere's radius is the only parameter that is not a count
+	float paramMaximum(const ShapeName& shape, int param) {
+		return shape.shape == SHAPE_SPHERE && param == 0 ? maxRadius : maxTessellation;
+	}
+
+	//Index of the first parameter outside its range, -1 when every one is usable. NaN fails every comparison
+	int invalidParam(const ShapeName& shape, const SceneMeshDesc& mesh) {
+		for (int i = 0; i < shape.paramCount; i++) {
+			if (!(mesh.params[i] >= shape.minimums[i] && mesh.params[i] <= paramMaximum(shape, i))) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	const ShapeName* findShape(uint32_t shape) {
+		for (size_t i = 0; i < sizeof(shapeNames) / sizeof(shapeNames[0]); i++) {
+			if ((uint32_t)shapeNames[i].shape == shape) {
+				return &shapeNames[i];
+			}
+		}
+		return 0;
+	}
+
+	bool modifiedTime(const string& path, time_t& time) {
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0) {
+			return false;
+		}
+		time = info.st_mtime;
+		return true;
+	}
+
+	//Reads "tx ty tz  angle ax ay az  sx sy sz", the angle is in radians and the axis is normalized here
+	bool readTransform(istringstream& in, SceneNodeDesc& node) {
+		float angle, ax, ay, az;
+		in >> node.translation[0] >> node.translation[1] >> node.translation[2]
+			>> angle >> ax >> ay >> az
+			>> node.scale[0] >> node.scale[1] >> node.scale[2];
+		if (!in) {
+			return false;
+		}
+
+		float length = sqrt(ax * ax + ay * ay + az * az);
+		float s = length > 0.0f ? sin(angle * 0.5f) / length : 0.0f;
+		node.rotation[0] = ax * s;
+		node.rotation[1] = ay * s;
+		node.rotation[2] = az * s;
+		node.rotation[3] = length > 0.0f ? cos(angle * 0.5f) : 1.0f;
+		return true;
+	}
+
+	//Looks up a name declared earlier, "-" means none
+	bool lookup(const map<string, uint32_t>& names, const string& name, uint32_t& index) {
+		if (name == "-") {
+			index = SCENE_NONE;
+			return true;
+		}
+		map<string, uint32_t>::const_iterator found = names.find(name);
+		if (found == names.end()) {
+			return false;
+		}
+		index = found->second;
+		return true;
+	}
+}
+
+SceneFile::SceneFile() : header(), meshes(0), textures(0), nodes(0), objects(0), mapping(0), mappingSize(0)
+#ifdef _WIN32
+	, fileHandle(INVALID_HANDLE_VALUE), mappingHandle(0)
+#endif
+{
+}
+
+SceneFile::~SceneFile() {
+	close();
+}
+
+bool SceneFile::load(const string& path) {
+	string binaryPath = path + ".bin";
+
+	time_t textTime = 0;
+	time_t binaryTime = 0;
+	bool hasText = modifiedTime(path, textTime);
+	bool hasBinary = modifiedTime(binaryPath, binaryTime);
+
+	//The compiled scene is only trusted while it is at least as new as its source
+	if (hasBinary && (!hasText || binaryTime >= textTime) && mapBinary(binaryPath)) {
+		cout << "Scene " << binaryPath << " mapped: " << objectCount() << " objects" << endl;
+		return true;
+	}
+
+	if (!parseText(path)) {
+		return false;
+	}
+	cout << "Scene " << path << " parsed: " << objectCount() << " objects" << endl;
+
+	if (!writeBinary(binaryPath)) {
+		cout << "Could not write compiled scene " << binaryPath << endl;
+	}
+	return true;
+}
+
+bool SceneFile::parseText(const string& path) {
+	close();
+
+	ifstream file(path.c_str());
+	if (!file) {
+		cerr << "Failed to open scene " << path << endl;
+		return false;
+	}
+
+	map<string, uint32_t> meshNames;
+	map<string, uint32_t> textureNames;
+	map<string, uint32_t> nodeNames;
+
+	string line;
+	int lineNumber = 0;
+	while (getline(file, line)) {
+		lineNumber++;
+
+		istringstream in(line);
+		string keyword;
+		if (!(in >> keyword) || keyword[0] == '#') {
+			continue;
+		}
+
+		string name;
+		in >> name;
+		bool valid = !name.empty();
+
+		if (keyword == "mesh") {
+			string shapeName;
+			in >> shapeName;
+
+			const ShapeName* shape = 0;
+			for (size_t i = 0; i < sizeof(shapeNames) / sizeof(shapeNames[0]); i++) {
+				if (shapeName == shapeNames[i].name) {
+					shape = &shapeNames[i];
+				}
+			}
+			valid = valid && shape != 0;
+
+			SceneMeshDesc mesh = {};
+			if (valid) {
+				mesh.shape = shape->shape;
+				for (int i = 0; i < SCENE_MESH_PARAMS; i++) {
+					mesh.params[i] = shape->defaults[i];
+				}
+				//Optional parameters override the defaults in order
+				for (int i = 0; i < shape->paramCount; i++) {
+					float value;
+					if (in >> value) {
+						mesh.params[i] = value;
+					}
+				}
+				int param = invalidParam(*shape, mesh);
+				if (param >= 0) {
+					cerr << path << "(" << lineNumber << "): " << shape->name << " parameter " << param + 1 << " is " << mesh.params[param]
+						<< ", it must be between " << shape->minimums[param] << " and " << paramMaximum(*shape, param) << endl;
+					valid = false;
+				}
+			}
+			if (valid) {
+				meshNames[name] = (uint32_t)parsedMeshes.size();
+				parsedMeshes.push_back(mesh);
+			}
+		}
+		else if (keyword == "texture") {
+			string texturePath;
+			in >> quoted(texturePath);
+			valid = valid && !texturePath.empty() && texturePath.size() < (size_t)SCENE_PATH_LENGTH;
+
+			if (valid) {
+				SceneTextureDesc texture = {};
+				strncpy(texture.path, texturePath.c_str(), SCENE_PATH_LENGTH - 1);
+				textureNames[name] = (uint32_t)parsedTextures.size();
+				parsedTextures.push_back(texture);
+			}
+		}
+		else if (keyword == "node" || keyword == "object") {
+			string parentName;
+			in >> parentName;
+
+			SceneNodeDesc node = {};
+			valid = valid && lookup(nodeNames, parentName, node.parent);
+
+			SceneObjectDesc object = {};
+			if (keyword == "object") {
+				string meshName, textureName;
+				in >> meshName >> textureName;
+				valid = valid && meshName != "-" && lookup(meshNames, meshName, object.mesh) && lookup(textureNames, textureName, object.texture);
+			}
+			valid = valid && readTransform(in, node);
+
+			if (valid) {
+				nodeNames[name] = (uint32_t)parsedNodes.size();
+				object.node = (uint32_t)parsedNodes.size();
+				parsedNodes.push_back(node);
+				if (keyword == "object") {
+					parsedObjects.push_back(object);
+				}
+			}
+		}
+		else {
+			valid = false;
+		}
+
+		if (!valid) {
+			cerr << path << "(" << lineNumber << "): invalid " << keyword << " statement" << endl;
+			close();
+			return false;
+		}
+	}
+
+	memcpy(header.magic, sceneMagic, sizeof(sceneMagic));
+	header.version = sceneVersion;
+	header.meshCount = (uint32_t)parsedMeshes.size();
+	header.textureCount = (uint32_t)parsedTextures.size();
+	header.nodeCount = (uint32_t)parsedNodes.size();
+	header.objectCount = (uint32_t)parsedObjects.size();
+	pointAtParsed();
+	return true;
+}
+
+bool SceneFile::writeBinary(const string& path) const {
+	ofstream file(path.c_str(), ios::binary | ios::trunc);
+	if (!file) {
+		return false;
+	}
+
+	//Header followed by each array in turn, nothing needs fixing up when the file is mapped back
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)meshes, header.meshCount * sizeof(SceneMeshDesc));
+	file.write((const char*)textures, header.textureCount * sizeof(SceneTextureDesc));
+	file.write((const char*)nodes, header.nodeCount * sizeof(SceneNodeDesc));
+	file.write((const char*)objects, header.objectCount * sizeof(SceneObjectDesc));
+	return (bool)file;
+}
+
+bool SceneFile::mapBinary(const string& path) {
+	close();
+
+#ifdef _WIN32
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(fileHandle, &size);
+	mappingSize = (size_t)size.QuadPart;
+	mappingHandle = mappingSize > 0 ? CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	mapping = mappingHandle != NULL ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+	int descriptor = open(path.c_str(), O_RDONLY);
+	if (descriptor < 0) {
+		return false;
+	}
+	struct stat info;
+	fstat(descriptor, &info);
+	mappingSize = (size_t)info.st_size;
+	mapping = mappingSize > 0 ? mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, descriptor, 0) : NULL;
+	if (mapping == MAP_FAILED) {
+		mapping = NULL;
+	}
+	//The mapping keeps the file contents alive on its own
+	::close(descriptor);
+#endif
+	if (mapping == NULL) {
+		close();
+		return false;
+	}
+
+	//Reject files from another version or ones cut short, everything else is trusted as written
+	const char* bytes = (const char*)mapping;
+	if (mappingSize < sizeof(SceneHeader)) {
+		close();
+		return false;
+	}
+	memcpy(&header, bytes, sizeof(header));
+	size_t expected = sizeof(SceneHeader) +
+		header.meshCount * sizeof(SceneMeshDesc) +
+		header.textureCount * sizeof(SceneTextureDesc) +
+		header.nodeCount * sizeof(SceneNodeDesc) +
+		header.objectCount * sizeof(SceneObjectDesc);
+	if (memcmp(header.magic, sceneMagic, sizeof(sceneMagic)) != 0 || header.version != sceneVersion || mappingSize != expected) {
+		close();
+		return false;
+	}
+
+	const char* cursor = bytes + sizeof(SceneHeader);
+	meshes = (const SceneMeshDesc*)cursor;
+	cursor += header.meshCount * sizeof(SceneMeshDesc);
+	textures = (const SceneTextureDesc*)cursor;
+	cursor += header.textureCount * sizeof(SceneTextureDesc);
+	nodes = (const SceneNodeDesc*)cursor;
+	cursor += header.nodeCount * sizeof(SceneNodeDesc);
+	objects = (const SceneObjectDesc*)cursor;
+
+	//Indices, parameters and strings are checked once here so the renderer can use them without checks of its own
+	for (uint32_t i = 0; i < header.meshCount; i++) {
+		const ShapeName* shape = findShape(meshes[i].shape);
+		if (shape == 0 || invalidParam(*shape, meshes[i]) >= 0) {
+			cerr << "Compiled scene " << path << ": mesh " << i << " has an unknown shape or parameters out of range" << endl;
+			close();
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header.textureCount; i++) {
+		if (memchr(textures[i].path, 0, SCENE_PATH_LENGTH) == NULL) {
+			cerr << "Compiled scene " << path << ": texture " << i << " has an unterminated path" << endl;
+			close();
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header.nodeCount; i++) {
+		if (nodes[i].parent != SCENE_NONE && nodes[i].parent >= i) {
+			close();
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header.objectCount; i++) {
+		const SceneObjectDesc& object = objects[i];
+		if (object.node >= header.nodeCount || object.mesh >= header.meshCount ||
+			(object.texture != SCENE_NONE && object.texture >= header.textureCount)) {
+			close();
+			return false;
+		}
+	}
+	return true;
+}
+
+void SceneFile::close() {
+#ifdef _WIN32
+	if (mapping != NULL) {
+		UnmapViewOfFile(mapping);
+	}
+	if (mappingHandle != NULL) {
+		CloseHandle(mappingHandle);
+		mappingHandle = NULL;
+	}
+	if (fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(fileHandle);
+		fileHandle = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (mapping != NULL) {
+		munmap(mapping, mappingSize);
+	}
+#endif
+	mapping = NULL;
+	mappingSize = 0;
+
+	parsedMeshes.clear();
+	parsedTextures.clear();
+	parsedNodes.clear();
+	parsedObjects.clear();
+
+	header = SceneHeader();
+	meshes = 0;
+	textures = 0;
+	nodes = 0;
+	objects = 0;
+}
+
+void SceneFile::pointAtParsed() {
+	meshes = parsedMeshes.data();
+	textures = parsedTextures.data();
+	nodes = parsedNodes.data();
+	objects = parsedObjects.data();
+}
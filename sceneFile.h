@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Shapes a scene can ask for, each built by its own function in Render.cpp
+enum SceneShape {
+	SHAPE_CUBE,
+	SHAPE_CYLINDER,
+	SHAPE_TORUS,
+	SHAPE_PLANE,
+	SHAPE_PYRAMID,
+	SHAPE_SPHERE
+};
+
+const std::uint32_t SCENE_NONE = 0xFFFFFFFFu; //No parent or no texture
+const int SCENE_PATH_LENGTH = 120;
+const int SCENE_MESH_PARAMS = 3;
+
+//Records below are plain 4 byte aligned data, written to the binary file as is and read back in place
+
+//A mesh built once at startup, params are the shape's tessellation settings
+struct SceneMeshDesc {
+	std::uint32_t shape;
+	float params[SCENE_MESH_PARAMS];
+};
+
+struct SceneTextureDesc {
+	char path[SCENE_PATH_LENGTH];
+};
+
+//Stored parent first, so a node's parent always has a lower index
+struct SceneNodeDesc {
+	std::uint32_t parent;
+	float translation[3];
+	float rotation[4]; //Quaternion x, y, z, w
+	float scale[3];
+};
+
+struct SceneObjectDesc {
+	std::uint32_t node;
+	std::uint32_t mesh;
+	std::uint32_t texture;
+};
+
+struct SceneHeader {
+	char magic[4];
+	std::uint32_t version;
+	std::uint32_t meshCount;
+	std::uint32_t textureCount;
+	std::uint32_t nodeCount;
+	std::uint32_t objectCount;
+};
+
+//Scene description read either from the text format or from its compiled binary form.
+//A mapped binary is used directly, the arrays below point into the mapping
+class SceneFile
+{
+public:
+	SceneFile();
+	~SceneFile();
+
+	//Maps path + ".bin" when it is newer than the text file, otherwise parses the text and compiles the binary for next time
+	bool load(const std::string& path);
+
+	bool parseText(const std::string& path);
+	bool writeBinary(const std::string& path) const;
+	bool mapBinary(const std::string& path);
+	void close();
+
+	std::uint32_t meshCount() const { return header.meshCount; }
+	std::uint32_t textureCount() const { return header.textureCount; }
+	std::uint32_t nodeCount() const { return header.nodeCount; }
+	std::uint32_t objectCount() const { return header.objectCount; }
+
+	const SceneMeshDesc& mesh(std::uint32_t i) const { return meshes[i]; }
+	const SceneTextureDesc& texture(std::uint32_t i) const { return textures[i]; }
+	const SceneNodeDesc& node(std::uint32_t i) const { return nodes[i]; }
+	const SceneObjectDesc& object(std::uint32_t i) const { return objects[i]; }
+
+private:
+	SceneFile(const SceneFile&);
+	SceneFile& operator=(const SceneFile&);
+
+	void pointAtParsed();
+
+	SceneHeader header;
+	const SceneMeshDesc* meshes;
+	const SceneTextureDesc* textures;
+	const SceneNodeDesc* nodes;
+	const SceneObjectDesc* objects;
+
+	//Storage behind the arrays when the scene came from text
+	std::vector<SceneMeshDesc> parsedMeshes;
+	std::vector<SceneTextureDesc> parsedTextures;
+	std::vector<SceneNodeDesc> parsedNodes;
+	std::vector<SceneObjectDesc> parsedObjects;
+
+	//Mapping behind the arrays when the scene came from the binary file
+	void* mapping;
+	std::size_t mappingSize;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+};
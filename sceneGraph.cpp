@@ -0,0 +1,82 @@
+#include "sceneGraph.h"
+
+glm::mat4 composeTransform(const Transform& transform) {
+	glm::mat4 matrix = glm::mat4_cast(transform.rotation);
+	matrix[0] *= transform.scale.x;
+	matrix[1] *= transform.scale.y;
+	matrix[2] *= transform.scale.z;
+	matrix[3] = glm::vec4(transform.translation, 1.0f);
+	return matrix;
+}
+
+SceneGraph::SceneGraph() : lastUpdateCount(0) {
+}
+
+NodeHandle SceneGraph::addNode(const Transform& local, NodeHandle parent) {
+	parents.push_back(parent);
+	locals.push_back(local);
+	worlds.push_back(glm::mat4(1.0f));
+	normals.push_back(glm::mat3(1.0f));
+	uniformScale.push_back(1);
+	dirty.push_back(1);
+	updated.push_back(0);
+	return (NodeHandle)(parents.size() - 1);
+}
+
+void SceneGraph::setTransform(NodeHandle node, const Transform& local) {
+	locals[node] = local;
+	dirty[node] = 1;
+}
+
+void SceneGraph::setTranslation(NodeHandle node, const glm::vec3& translation) {
+	locals[node].translation = translation;
+	dirty[node] = 1;
+}
+
+void SceneGraph::setRotation(NodeHandle node, const glm::quat& rotation) {
+	locals[node].rotation = rotation;
+	dirty[node] = 1;
+}
+
+void SceneGraph::setScale(NodeHandle node, const glm::vec3& scale) {
+	locals[node].scale = scale;
+	dirty[node] = 1;
+}
+
+unsigned int SceneGraph::update() {
+	lastUpdateCount = 0;
+
+	//Parents come first in storage, so by the time a child is visited its parent's flag is final
+	for (std::size_t i = 0; i < parents.size(); i++) {
+		NodeHandle parent = parents[i];
+		bool parentUpdated = parent != ROOT_NODE && updated[parent];
+
+		if (dirty[i] || parentUpdated) {
+			glm::mat4 local = composeTransform(locals[i]);
+			worlds[i] = parent == ROOT_NODE ? local : worlds[parent] * local;
+
+			//The inverse transpose of translate * rotate * scale is the parent's normal matrix * rotate * inverse scale,
+			//so no matrix is inverted. With uniform scales all the way up it only differs from the world's 3x3 by a factor,
+			//which the shader's normalize removes
+			const glm::vec3& scale = locals[i].scale;
+			uniformScale[i] = scale.x == scale.y && scale.y == scale.z && (parent == ROOT_NODE || uniformScale[parent]);
+			if (uniformScale[i]) {
+				normals[i] = glm::mat3(worlds[i]);
+			}
+			else {
+				glm::mat3 localNormal = glm::mat3_cast(locals[i].rotation);
+				localNormal[0] /= scale.x;
+				localNormal[1] /= scale.y;
+				localNormal[2] /= scale.z;
+				normals[i] = parent == ROOT_NODE ? localNormal : normals[parent] * localNormal;
+			}
+			dirty[i] = 0;
+			updated[i] = 1;
+			lastUpdateCount++;
+		}
+		else {
+			updated[i] = 0;
+		}
+	}
+	return lastUpdateCount;
+}
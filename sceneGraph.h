@@ -0,0 +1,62 @@
+#pragma once
+#include <vector>
+
+//GLM Math headers
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+//Index of a node inside the scene graph
+typedef unsigned int NodeHandle;
+
+const NodeHandle ROOT_NODE = ~0u; //Parent of top level nodes
+
+//Local transform of a node, applied as translate * rotate * scale
+struct Transform {
+	glm::vec3 translation;
+	glm::quat rotation;
+	glm::vec3 scale;
+
+	Transform() : translation(0.0f), rotation(), scale(1.0f) {}
+	Transform(const glm::vec3& t, const glm::quat& r = glm::quat(), const glm::vec3& s = glm::vec3(1.0f)) : translation(t), rotation(r), scale(s) {}
+};
+
+//Hierarchy of transforms with cached world matrices. A node's world matrix is only recomputed
+//when the node or one of its ancestors changed since the last update()
+class SceneGraph
+{
+public:
+	SceneGraph();
+
+	//Parents must be added before their children, which keeps update() a single pass in storage order
+	NodeHandle addNode(const Transform& local, NodeHandle parent = ROOT_NODE);
+
+	void setTransform(NodeHandle node, const Transform& local);
+	void setTranslation(NodeHandle node, const glm::vec3& translation);
+	void setRotation(NodeHandle node, const glm::quat& rotation);
+	void setScale(NodeHandle node, const glm::vec3& scale);
+
+	const Transform& getTransform(NodeHandle node) const { return locals[node]; }
+	NodeHandle getParent(NodeHandle node) const { return parents[node]; }
+	const glm::mat4& getWorld(NodeHandle node) const { return worlds[node]; }
+	//Transforms the node's normals to world space, up to a scale factor, cached alongside the world matrix
+	const glm::mat3& getNormal(NodeHandle node) const { return normals[node]; }
+	bool wasUpdated(NodeHandle node) const { return updated[node] != 0; } //World matrix changed in the last update()
+	unsigned int size() const { return (unsigned int)parents.size(); }
+
+	//Recomputes the world matrix of every dirty node and its descendants, returns how many were computed
+	unsigned int update();
+	unsigned int getLastUpdateCount() const { return lastUpdateCount; }
+
+private:
+	std::vector<NodeHandle> parents;
+	std::vector<Transform> locals;
+	std::vector<glm::mat4> worlds;
+	std::vector<glm::mat3> normals;
+	std::vector<unsigned char> uniformScale; //Every scale from the root down to the node is the same on all three axes
+	std::vector<unsigned char> dirty; //Local transform changed since the last update
+	std::vector<unsigned char> updated; //World matrix recomputed during the current update, read by children
+	unsigned int lastUpdateCount;
+};
+
+//Builds translate * rotate * scale without multiplying three full matrices
+glm::mat4 composeTransform(const Transform& transform);
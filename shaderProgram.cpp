@@ -0,0 +1,250 @@
+#include "shaderProgram.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+//GLM Math headers
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace std;
+
+namespace {
+	typedef chrono::high_resolution_clock Clock;
+
+	double elapsedMs(Clock::time_point start) {
+		return chrono::duration<double, milli>(Clock::now() - start).count();
+	}
+
+	//Arrays are reported as "name[0]", store them under their plain name as well
+	string baseName(const char* reported) {
+		string result(reported);
+		size_t bracket = result.find("[0]");
+		if (bracket != string::npos && bracket + 3 == result.size()) {
+			result.erase(bracket);
+		}
+		return result;
+	}
+}
+
+ShaderProgram::ShaderProgram() : programID(0), compileMs(0.0), linkMs(0.0), cached(false), vertShaderID(0), fragShaderID(0), key(0),
+	pendingCache(NULL) {
+}
+
+bool ShaderProgram::build(const char* programName, const char* vertShaderSource, const char* fragShaderSource, const ProgramCache* cache) {
+	begin(programName, vertShaderSource, fragShaderSource, cache);
+	return finish();
+}
+
+void ShaderProgram::begin(const char* programName, const char* vertShaderSource, const char* fragShaderSource, const ProgramCache* cache) {
+	name = programName;
+	compileMs = 0.0;
+	linkMs = 0.0;
+	cached = false;
+	pendingCache = NULL;
+	beginTime = Clock::now();
+
+	//A binary from an earlier run with the same sources and driver skips compiling and linking entirely
+	bool useCache = cache != NULL && cache->isOpen();
+	if (useCache) {
+		key = cache->key(vertShaderSource, fragShaderSource);
+		programID = glCreateProgram();
+		cached = cache->load(name, key, programID);
+		linkMs = elapsedMs(beginTime);
+		if (cached) {
+			return;
+		}
+		glDeleteProgram(programID);
+		programID = 0;
+		cout << "Shader program " << name << " cache miss after " << linkMs << " ms, building from source" << endl;
+		pendingCache = cache;
+	}
+
+	//Compile vertex and fragment shaders and link them without asking for any status, which would wait for the driver
+	vertShaderID = beginStage(GL_VERTEX_SHADER, vertShaderSource);
+	fragShaderID = beginStage(GL_FRAGMENT_SHADER, fragShaderSource);
+
+	//Attatch shaders and link shader program
+	programID = glCreateProgram();
+	if (useCache) {
+		glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glAttachShader(programID, vertShaderID);
+	glAttachShader(programID, fragShaderID);
+	glLinkProgram(programID);
+}
+
+bool ShaderProgram::finish() {
+	if (cached) {
+		return finishLink();
+	}
+
+	//The first status query waits for the stage, so the compile time includes any time spent in the driver's queue
+	bool compiled = checkStage(GL_VERTEX_SHADER, vertShaderID) && checkStage(GL_FRAGMENT_SHADER, fragShaderID);
+	compileMs = elapsedMs(beginTime);
+	if (!compiled) {
+		deleteStages();
+		destroy();
+		return false;
+	}
+
+	Clock::time_point linkStart = Clock::now();
+	GLint linked = GL_FALSE;
+	glGetProgramiv(programID, GL_LINK_STATUS, &linked);
+	linkMs = elapsedMs(linkStart);
+
+	//Shader objects are no longer needed once the program is linked
+	deleteStages();
+
+	if (linked != GL_TRUE) {
+		GLchar log[1024];
+		glGetProgramInfoLog(programID, sizeof(log), NULL, log);
+		cerr << "Shader program " << name << " failed to link:" << endl << log << endl;
+		destroy();
+		return false;
+	}
+
+	if (pendingCache != NULL) {
+		Clock::time_point saveStart = Clock::now();
+		if (pendingCache->save(name, key, programID)) {
+			cout << "Shader program " << name << " saved to the cache in " << elapsedMs(saveStart) << " ms" << endl;
+		}
+		else {
+			cout << "Shader program " << name << " could not be saved to the cache" << endl;
+		}
+		pendingCache = NULL;
+	}
+	return finishLink();
+}
+
+bool ShaderProgram::finishLink() {
+	reflect();
+
+	if (cached) {
+		cout << "Shader program " << name << " cache hit: loaded in " << linkMs << " ms, ";
+	}
+	else {
+		cout << "Shader program " << name << " built: compile " << compileMs << " ms, link " << linkMs << " ms, ";
+	}
+	cout << uniforms.size() << " uniforms, " << attributes.size() << " attributes" << endl;
+	return true;
+}
+
+bool ShaderProgram::validate() const {
+	glValidateProgram(programID);
+	GLint valid = GL_FALSE;
+	glGetProgramiv(programID, GL_VALIDATE_STATUS, &valid);
+	if (valid != GL_TRUE) {
+		GLchar log[1024];
+		glGetProgramInfoLog(programID, sizeof(log), NULL, log);
+		cout << "Shader program " << name << " did not validate: " << log << endl;
+		return false;
+	}
+	return true;
+}
+
+void ShaderProgram::destroy() {
+	if (programID != 0) {
+		glDeleteProgram(programID);
+		programID = 0;
+	}
+	uniforms.clear();
+	attributes.clear();
+}
+
+GLint ShaderProgram::uniform(const char* uniformName) const {
+	map<string, GLint>::const_iterator found = uniforms.find(uniformName);
+	if (found == uniforms.end()) {
+		return -1;
+	}
+	return found->second;
+}
+
+GLint ShaderProgram::attribute(const char* attributeName) const {
+	map<string, GLint>::const_iterator found = attributes.find(attributeName);
+	if (found == attributes.end()) {
+		return -1;
+	}
+	return found->second;
+}
+
+void ShaderProgram::setInt(GLint location, int value) const {
+	glProgramUniform1i(programID, location, value);
+}
+
+void ShaderProgram::setVec2(GLint location, const glm::vec2& value) const {
+	glProgramUniform2fv(programID, location, 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::setVec3(GLint location, const glm::vec3& value) const {
+	glProgramUniform3fv(programID, location, 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::setMat4(GLint location, const glm::mat4& value) const {
+	glProgramUniformMatrix4fv(programID, location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+GLuint ShaderProgram::beginStage(GLenum stage, const char* source) {
+	GLuint shaderID = glCreateShader(stage);
+	glShaderSource(shaderID, 1, &source, NULL);
+	glCompileShader(shaderID);
+	return shaderID;
+}
+
+bool ShaderProgram::checkStage(GLenum stage, GLuint shaderID) {
+	GLint compiled = GL_FALSE;
+	glGetShaderiv(shaderID, GL_COMPILE_STATUS, &compiled);
+	if (compiled != GL_TRUE) {
+		GLchar log[1024];
+		glGetShaderInfoLog(shaderID, sizeof(log), NULL, log);
+		cerr << "Shader program " << name << ": " << (stage == GL_VERTEX_SHADER ? "vertex" : "fragment")
+			<< " shader failed to compile:" << endl << log << endl;
+		return false;
+	}
+	return true;
+}
+
+void ShaderProgram::deleteStages() {
+	if (programID != 0) {
+		glDetachShader(programID, vertShaderID);
+		glDetachShader(programID, fragShaderID);
+	}
+	glDeleteShader(vertShaderID);
+	glDeleteShader(fragShaderID);
+	vertShaderID = 0;
+	fragShaderID = 0;
+}
+
+void ShaderProgram::reflect() {
+	uniforms.clear();
+	attributes.clear();
+
+	GLint count = 0;
+	GLint maxLength = 0;
+	GLint size = 0;
+	GLenum type = GL_NONE;
+
+	//Enumerate every active uniform once, uniforms inside blocks have no location and are skipped
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	vector<GLchar> buffer(maxLength > 0 ? maxLength : 1);
+	for (GLint i = 0; i < count; i++) {
+		glGetActiveUniform(programID, (GLuint)i, (GLsizei)buffer.size(), NULL, &size, &type, &buffer[0]);
+		GLint location = glGetUniformLocation(programID, &buffer[0]);
+		if (location >= 0) {
+			uniforms[baseName(&buffer[0])] = location;
+		}
+	}
+
+	//Enumerate every active vertex attribute once
+	glGetProgramiv(programID, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(programID, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+	buffer.assign(maxLength > 0 ? maxLength : 1, 0);
+	for (GLint i = 0; i < count; i++) {
+		glGetActiveAttrib(programID, (GLuint)i, (GLsizei)buffer.size(), NULL, &size, &type, &buffer[0]);
+		GLint location = glGetAttribLocation(programID, &buffer[0]);
+		if (location >= 0) {
+			attributes[baseName(&buffer[0])] = location;
+		}
+	}
+}
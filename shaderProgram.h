@@ -0,0 +1,69 @@
+#pragma once
+#include <GL/glew.h>
+#include <chrono>
+#include <map>
+#include <string>
+
+//GLM Math headers
+#include <glm/glm.hpp>
+
+#include "programCache.h"
+
+//Linked GLSL program whose active uniforms and attributes are enumerated once, right after linking
+class ShaderProgram
+{
+public:
+	ShaderProgram();
+
+	//Compile, link and reflect. With an open cache a binary saved by an earlier run replaces compiling and linking,
+	//and a program built from source is saved for the next one
+	bool build(const char* name, const char* vertShaderSource, const char* fragShaderSource, const ProgramCache* cache = NULL);
+
+	//build() in two halves: begin only hands the sources to the driver, finish waits for the result and reports it.
+	//Beginning several programs before finishing any lets a driver with parallel shader compilation work on all of them
+	void begin(const char* name, const char* vertShaderSource, const char* fragShaderSource, const ProgramCache* cache = NULL);
+	bool finish();
+	//Checks the program against the current GL state, so call it once its sampler units are set and a VAO is bound.
+	//A failure is reported, the caller decides whether it matters
+	bool validate() const;
+	void destroy();
+	void use() const { glUseProgram(programID); }
+
+	GLuint getID() const { return programID; }
+	const std::string& getName() const { return name; }
+	double getCompileTime() const { return compileMs; } //Milliseconds from handing over the sources until both stages compiled
+	double getLinkTime() const { return linkMs; } //Milliseconds spent linking, or loading the cached binary
+	bool isCached() const { return cached; } //Loaded from the program binary cache
+
+	//Locations come from the reflection tables, so resolve them at startup and keep the result
+	GLint uniform(const char* uniformName) const;
+	GLint attribute(const char* attributeName) const;
+
+	//Typed setters take a pre-resolved location, so the per-frame path never does a string lookup
+	void setInt(GLint location, int value) const;
+	void setVec2(GLint location, const glm::vec2& value) const;
+	void setVec3(GLint location, const glm::vec3& value) const;
+	void setMat4(GLint location, const glm::mat4& value) const;
+
+private:
+	GLuint beginStage(GLenum stage, const char* source);
+	bool checkStage(GLenum stage, GLuint shaderID);
+	void deleteStages();
+	bool finishLink(); //Reflects a linked program and reports how it was built
+	void reflect();
+
+	GLuint programID;
+	std::string name;
+	std::map<std::string, GLint> uniforms;
+	std::map<std::string, GLint> attributes;
+	double compileMs;
+	double linkMs;
+	bool cached;
+
+	//Between begin() and finish()
+	GLuint vertShaderID;
+	GLuint fragShaderID;
+	ProgramKey key;
+	const ProgramCache* pendingCache; //Saves the program once it links, NULL when it came from the cache
+	std::chrono::high_resolution_clock::time_point beginTime;
+};
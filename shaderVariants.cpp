@@ -0,0 +1,89 @@
+#include "shaderVariants.h"
+
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+	//Define names in feature bit order, shared by both stages
+	const char* const featureNames[SHADER_FEATURE_COUNT] = { "TEXTURED", "LIT", "SPECULAR", "SHADOWED", "LIGHTMAPPED" };
+}
+
+ShaderVariants::ShaderVariants() : vertSource(NULL), fragSource(NULL), cache(NULL) {
+	for (unsigned int i = 0; i < VARIANT_COUNT; i++) {
+		requested[i] = false;
+		pending[i] = false;
+	}
+}
+
+bool ShaderVariants::enableParallelCompile() {
+	if (GLEW_KHR_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+		return true;
+	}
+	return false;
+}
+
+void ShaderVariants::setSource(const char* name, const char* vertShaderSource, const char* fragShaderSource, const ProgramCache* programCache) {
+	baseName = name;
+	vertSource = vertShaderSource;
+	fragSource = fragShaderSource;
+	cache = programCache;
+}
+
+ShaderProgram& ShaderVariants::request(unsigned int features) {
+	if (!requested[features]) {
+		requested[features] = true;
+		pending[features] = true;
+
+		//Named after its features, so each variant has a cache file of its own
+		string name = baseName;
+		for (unsigned int i = 0; i < SHADER_FEATURE_COUNT; i++) {
+			if (features & (1u << i)) {
+				name += string(" ") + featureNames[i];
+			}
+		}
+		programs[features].begin(name.c_str(), inject(vertSource, features).c_str(), inject(fragSource, features).c_str(), cache);
+	}
+	return programs[features];
+}
+
+bool ShaderVariants::finish() {
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	unsigned int finished = 0;
+	bool succeeded = true;
+	for (unsigned int i = 0; i < VARIANT_COUNT; i++) {
+		if (pending[i]) {
+			pending[i] = false;
+			succeeded = programs[i].finish() && succeeded;
+			finished++;
+		}
+	}
+	if (finished > 0) {
+		cout << finished << " " << baseName << " shader variants ready after "
+			<< chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count() << " ms" << endl;
+	}
+	return succeeded;
+}
+
+void ShaderVariants::destroy() {
+	for (unsigned int i = 0; i < VARIANT_COUNT; i++) {
+		programs[i].destroy();
+		requested[i] = false;
+		pending[i] = false;
+	}
+}
+
+string ShaderVariants::inject(const char* source, unsigned int features) const {
+	//GLSL only allows the #version line first, everything else follows it
+	string text(source);
+	size_t lineEnd = text.find('\n');
+	lineEnd = lineEnd == string::npos ? text.size() : lineEnd + 1;
+
+	string defines;
+	for (unsigned int i = 0; i < SHADER_FEATURE_COUNT; i++) {
+		defines += string("#define ") + featureNames[i] + ((features & (1u << i)) ? " true\n" : " false\n");
+	}
+	return text.insert(lineEnd, defines);
+}
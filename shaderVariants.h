@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+
+#include "programCache.h"
+#include "shaderProgram.h"
+
+//Features a variant of the scene shaders is compiled with. Each one reaches GLSL as a define set to true or false,
+//so the compiler drops the code of every feature the variant lacks
+enum ShaderFeature {
+	SHADER_TEXTURED = 1 << 0, //Samples the instance's layer of the bound texture array, otherwise draws the tint alone
+	SHADER_LIT = 1 << 1, //Ambient and diffuse from the main light and the clustered point lights, otherwise unlit
+	SHADER_SPECULAR = 1 << 2, //Adds the highlights, needs SHADER_LIT
+	SHADER_SHADOWED = 1 << 3, //Takes the main light's visibility from the shadow map, needs SHADER_LIT
+	SHADER_LIGHTMAPPED = 1 << 4 //Reads ambient, diffuse and shadow from the baked lightmap instead, needs SHADER_LIT
+};
+
+const unsigned int SHADER_FEATURE_COUNT = 5;
+
+//Every combination of features built from one pair of sources. A variant is compiled the first time it is requested
+//and finished together with the others, so a driver with GL_KHR_parallel_shader_compile builds them side by side
+class ShaderVariants
+{
+public:
+	static const unsigned int VARIANT_COUNT = 1 << SHADER_FEATURE_COUNT;
+
+	ShaderVariants();
+
+	//Tells the driver it may compile on as many threads as it likes, false when it cannot
+	static bool enableParallelCompile();
+
+	//Both sources must start with their #version line, the defines go right after it
+	void setSource(const char* name, const char* vertShaderSource, const char* fragShaderSource, const ProgramCache* cache = NULL);
+
+	//Starts compiling the variant the first time, its program can be registered right away but only used after finish()
+	ShaderProgram& request(unsigned int features);
+	bool isRequested(unsigned int features) const { return requested[features]; }
+	ShaderProgram& get(unsigned int features) { return programs[features]; }
+
+	bool finish(); //Waits for every requested variant, false when one of them failed
+	void destroy();
+
+private:
+	std::string inject(const char* source, unsigned int features) const;
+
+	std::string baseName;
+	const char* vertSource;
+	const char* fragSource;
+	const ProgramCache* cache;
+	ShaderProgram programs[VARIANT_COUNT];
+	bool requested[VARIANT_COUNT];
+	bool pending[VARIANT_COUNT]; //Requested but not finished yet
+};
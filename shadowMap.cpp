@@ -0,0 +1,178 @@
+#include "shadowMap.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+//GLM Math headers
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+
+namespace {
+	//A point light shines all around it, so a frustum cannot hold everything it lights. It opens at most 80 degrees
+	//to each side of its axis
+	const float maxTangent = 5.67f;
+	//The near plane stays at least this fraction of the farthest point away from the light, which bounds the depth range
+	const float minNearRatio = 0.01f;
+	//Each pass turns the axis towards the middle of the points' angular extent
+	const int centeringPasses = 3;
+	//Extra tangent on each side, so the shader's filter taps at the outermost casters stay inside the map
+	const float edgeMargin = 0.01f;
+
+	struct LightBasis {
+		glm::vec3 forward;
+		glm::vec3 right;
+		glm::vec3 up;
+		glm::vec3 worldUp; //The up vector lookAt needs for the same basis
+	};
+
+	struct LightExtent {
+		float left, right, bottom, top; //Tangents of the angles off the axis
+		float nearDepth, farDepth;
+	};
+
+	LightBasis makeBasis(const glm::vec3& forward) {
+		//lookAt needs an up vector that is not parallel to the view direction
+		LightBasis basis;
+		basis.worldUp = fabs(forward.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		basis.forward = forward;
+		basis.right = glm::normalize(glm::cross(forward, basis.worldUp));
+		basis.up = glm::cross(basis.right, forward);
+		return basis;
+	}
+
+	//Tangent of a point's angle off the axis, a point no farther ahead than the near limit cannot be projected and goes to the edge
+	float sideTangent(float side, float depth, float nearLimit) {
+		if (depth <= nearLimit) {
+			return side < 0.0f ? -maxTangent : (side > 0.0f ? maxTangent : 0.0f);
+		}
+		return glm::clamp(side / depth, -maxTangent, maxTangent);
+	}
+
+	LightExtent measure(const glm::vec3& light, const vector<glm::vec3>& points, const LightBasis& basis, float nearLimit) {
+		LightExtent extent = { maxTangent, -maxTangent, maxTangent, -maxTangent, FLT_MAX, nearLimit };
+		for (size_t i = 0; i < points.size(); i++) {
+			glm::vec3 offset = points[i] - light;
+			float depth = glm::dot(offset, basis.forward);
+			float x = sideTangent(glm::dot(offset, basis.right), depth, nearLimit);
+			float y = sideTangent(glm::dot(offset, basis.up), depth, nearLimit);
+			extent.left = min(extent.left, x);
+			extent.right = max(extent.right, x);
+			extent.bottom = min(extent.bottom, y);
+			extent.top = max(extent.top, y);
+			extent.nearDepth = min(extent.nearDepth, max(depth, nearLimit));
+			extent.farDepth = max(extent.farDepth, depth);
+		}
+		return extent;
+	}
+}
+
+ShadowMap::ShadowMap() : framebuffer(0), depthTexture(0), size(0) {
+}
+
+bool ShadowMap::create(GLsizei mapSize) {
+	destroy();
+	size = mapSize;
+
+	glGenTextures(1, &depthTexture);
+	glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, size, size);
+
+	//Linear filtering on a comparison sampler blends four depth tests, the shader's kernel adds the rest of the PCF
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	//Everything outside the light's frustum reads as the far plane, so it is lit
+	const GLfloat border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+	glActiveTexture(GL_TEXTURE0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	//Starts out at the far plane, so a scene without casters is fully lit
+	if (status == GL_FRAMEBUFFER_COMPLETE) {
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		cerr << "Shadow map framebuffer incomplete: " << status << endl;
+		destroy();
+		return false;
+	}
+	return true;
+}
+
+void ShadowMap::destroy() {
+	if (framebuffer != 0) {
+		glDeleteFramebuffers(1, &framebuffer);
+		framebuffer = 0;
+	}
+	if (depthTexture != 0) {
+		glDeleteTextures(1, &depthTexture);
+		depthTexture = 0;
+	}
+	size = 0;
+}
+
+void ShadowMap::begin() {
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, size, size);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	//Pushes the stored depth back along the slope, so lit surfaces do not shadow themselves
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.0f, 4.0f);
+}
+
+void ShadowMap::end(GLsizei windowWidth, GLsizei windowHeight) {
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, windowWidth, windowHeight);
+}
+
+glm::mat4 lightViewProjection(const glm::vec3& light, const vector<glm::vec3>& points) {
+	//The light usually sits among the casters, above some and beside others, so aiming at the middle of their bounding sphere
+	//leaves many of them behind it. The average direction to the points starts the axis off inside their spread instead
+	glm::vec3 direction(0.0f);
+	float farthest = 0.0f;
+	for (size_t i = 0; i < points.size(); i++) {
+		glm::vec3 offset = points[i] - light;
+		float distance = glm::length(offset);
+		if (distance > 0.0f) {
+			direction += offset / distance;
+		}
+		farthest = max(farthest, distance);
+	}
+	float length = glm::length(direction);
+	LightBasis basis = makeBasis(length > 0.0f ? direction / length : glm::vec3(0.0f, -1.0f, 0.0f));
+	float nearLimit = max(farthest * minNearRatio, 0.001f);
+
+	//The average leans towards wherever the points crowd, turning to the middle of their extent evens out the sides
+	LightExtent extent = measure(light, points, basis, nearLimit);
+	for (int pass = 0; pass < centeringPasses; pass++) {
+		float x = tan((atan(extent.left) + atan(extent.right)) * 0.5f);
+		float y = tan((atan(extent.bottom) + atan(extent.top)) * 0.5f);
+		basis = makeBasis(glm::normalize(basis.forward + basis.right * x + basis.up * y));
+		extent = measure(light, points, basis, nearLimit);
+	}
+
+	//Off-center frustum through the outermost tangents on each side, from the nearest point to the farthest
+	float nearPlane = extent.nearDepth;
+	float farPlane = max(extent.farDepth, nearPlane + nearLimit);
+	glm::mat4 projection = glm::frustum((extent.left - edgeMargin) * nearPlane, (extent.right + edgeMargin) * nearPlane,
+		(extent.bottom - edgeMargin) * nearPlane, (extent.top + edgeMargin) * nearPlane, nearPlane, farPlane);
+	return projection * glm::lookAt(light, light + basis.forward, basis.worldUp);
+}
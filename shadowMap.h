@@ -0,0 +1,35 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+
+//GLM Math headers
+#include <glm/glm.hpp>
+
+const GLuint SHADOW_TEXTURE_UNIT = 1; //Texture unit the shadow map stays bound to, unit 0 belongs to the texture arrays
+
+//Depth of the scene as one light sees it, kept between frames and only redrawn when the light or a caster moves
+class ShadowMap
+{
+public:
+	ShadowMap();
+
+	//Creates a size by size depth texture set up for hardware depth comparison and binds it to SHADOW_TEXTURE_UNIT
+	bool create(GLsizei size);
+	void destroy();
+
+	//Redirects drawing into the map and clears it, casters drawn until end() write depth only
+	void begin();
+	//Back to the window's framebuffer and viewport
+	void end(GLsizei windowWidth, GLsizei windowHeight);
+
+	GLsizei getSize() const { return size; }
+
+private:
+	GLuint framebuffer;
+	GLuint depthTexture;
+	GLsizei size;
+};
+
+//Perspective view and projection from a point light, aimed at the middle of the points as the light sees them
+//and just wide and deep enough to hold them. Points beside or behind the light end up on the frustum's edge
+glm::mat4 lightViewProjection(const glm::vec3& light, const std::vector<glm::vec3>& points);
@@ -0,0 +1,44 @@
+#pragma once
+#include <atomic>
+
+//Fixed size queue between exactly one producer thread and one consumer thread, without locks.
+//Each side owns one index and only reads the other's, so a push and a pop never contend for the same slot
+template <typename T, unsigned int CAPACITY>
+class SpscRing
+{
+public:
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SpscRing capacity must be a power of two");
+
+	SpscRing() : head(0), tail(0), dropped(0) {}
+
+	//Producer side, false when the consumer has fallen a whole ring behind
+	bool push(const T& value) {
+		unsigned int write = tail.load(std::memory_order_relaxed);
+		if (write - head.load(std::memory_order_acquire) == CAPACITY) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		slots[write & (CAPACITY - 1)] = value;
+		tail.store(write + 1, std::memory_order_release);
+		return true;
+	}
+
+	//Consumer side, false when the ring is empty
+	bool pop(T& value) {
+		unsigned int read = head.load(std::memory_order_relaxed);
+		if (read == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		value = slots[read & (CAPACITY - 1)];
+		head.store(read + 1, std::memory_order_release);
+		return true;
+	}
+
+	unsigned int getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+	T slots[CAPACITY];
+	alignas(64) std::atomic<unsigned int> head; //Next slot to read, only written by the consumer
+	alignas(64) std::atomic<unsigned int> tail; //Next slot to write, only written by the producer
+	std::atomic<unsigned int> dropped;
+};
@@ -0,0 +1,120 @@
+#include "textureArrays.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+using namespace std;
+
+namespace {
+	int bucketSize(int size) {
+		int bucket = 1;
+		while (bucket < size && bucket < TextureArraySet::MAX_BUCKET_SIZE) {
+			bucket *= 2;
+		}
+		return bucket;
+	}
+
+	//Bilinear resample of an RGBA8 image, only used when an image does not already match its bucket
+	void resize(const unsigned char* source, int width, int height, unsigned char* target, int targetWidth, int targetHeight) {
+		for (int y = 0; y < targetHeight; y++) {
+			float sy = max((y + 0.5f) * height / targetHeight - 0.5f, 0.0f);
+			int y0 = min((int)sy, height - 1);
+			int y1 = min(y0 + 1, height - 1);
+			float fy = sy - y0;
+
+			for (int x = 0; x < targetWidth; x++) {
+				float sx = max((x + 0.5f) * width / targetWidth - 0.5f, 0.0f);
+				int x0 = min((int)sx, width - 1);
+				int x1 = min(x0 + 1, width - 1);
+				float fx = sx - x0;
+
+				for (int c = 0; c < 4; c++) {
+					float top = source[(y0 * width + x0) * 4 + c] * (1.0f - fx) + source[(y0 * width + x1) * 4 + c] * fx;
+					float bottom = source[(y1 * width + x0) * 4 + c] * (1.0f - fx) + source[(y1 * width + x1) * 4 + c] * fx;
+					target[(y * targetWidth + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+				}
+			}
+		}
+	}
+}
+
+TextureArraySet::TextureArraySet() : separateArrays(false) {
+}
+
+unsigned int TextureArraySet::add(const unsigned char* rgba, int width, int height) {
+	Image image;
+	image.pixels.assign(rgba, rgba + (size_t)width * height * 4);
+	image.width = width;
+	image.height = height;
+	images.push_back(image);
+
+	TextureLayer layer = {};
+	layers.push_back(layer);
+	return (unsigned int)(images.size() - 1);
+}
+
+void TextureArraySet::build(GLint wrapMode) {
+	//Images that share a bucket size become layers of the same array, in the order they were added
+	map<pair<int, int>, vector<unsigned int> > buckets;
+	for (unsigned int i = 0; i < (unsigned int)images.size(); i++) {
+		pair<int, int> size(bucketSize(images[i].width), bucketSize(images[i].height));
+		if (separateArrays) {
+			buckets[pair<int, int>(-(int)i - 1, 0)].push_back(i);
+		}
+		else {
+			buckets[size].push_back(i);
+		}
+	}
+
+	vector<unsigned char> resized;
+	for (map<pair<int, int>, vector<unsigned int> >::const_iterator bucket = buckets.begin(); bucket != buckets.end(); ++bucket) {
+		const vector<unsigned int>& members = bucket->second;
+		const Image& first = images[members[0]];
+		int width = separateArrays ? first.width : bucket->first.first;
+		int height = separateArrays ? first.height : bucket->first.second;
+		int levels = 1;
+		while ((max(width, height) >> levels) > 0) {
+			levels++;
+		}
+
+		GLuint texture = 0;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, width, height, (GLsizei)members.size());
+
+		for (unsigned int layer = 0; layer < (unsigned int)members.size(); layer++) {
+			const Image& image = images[members[layer]];
+			const unsigned char* pixels = image.pixels.data();
+			if (image.width != width || image.height != height) {
+				resized.resize((size_t)width * height * 4);
+				resize(pixels, image.width, image.height, resized.data(), width, height);
+				pixels = resized.data();
+			}
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+			layers[members[layer]].texture = texture;
+			layers[members[layer]].layer = layer;
+		}
+
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrapMode);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrapMode);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		arrays.push_back(texture);
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	//Everything lives on the GPU now
+	images.clear();
+}
+
+void TextureArraySet::destroy() {
+	if (!arrays.empty()) {
+		glDeleteTextures((GLsizei)arrays.size(), arrays.data());
+		arrays.clear();
+	}
+	images.clear();
+	layers.clear();
+}
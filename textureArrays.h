@@ -0,0 +1,45 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+
+//Where a texture ended up: the array texture to bind and the layer the shader samples
+struct TextureLayer {
+	GLuint texture;
+	GLuint layer;
+};
+
+//Gathers decoded RGBA8 images and packs them into as few GL_TEXTURE_2D_ARRAY objects as possible.
+//Images are grouped into buckets by their size rounded up to powers of two, each image is resized to its bucket's size,
+//so every material in a bucket is drawn with one texture bind
+class TextureArraySet
+{
+public:
+	static const int MAX_BUCKET_SIZE = 2048; //Larger images are scaled down to fit
+
+	TextureArraySet();
+
+	//Gives every image an array of its own at its original size, the one-texture-per-material layout
+	void setSeparate(bool separate) { separateArrays = separate; }
+
+	//Copies the image and returns its index, its layer is only known once build() has run
+	unsigned int add(const unsigned char* rgba, int width, int height);
+
+	//Creates one array per bucket, uploads every layer, builds mipmaps and releases the CPU copies
+	void build(GLint wrapMode);
+	void destroy();
+
+	const TextureLayer& getLayer(unsigned int image) const { return layers[image]; }
+	unsigned int getArrayCount() const { return (unsigned int)arrays.size(); }
+
+private:
+	struct Image {
+		std::vector<unsigned char> pixels;
+		int width;
+		int height;
+	};
+
+	bool separateArrays;
+	std::vector<Image> images;
+	std::vector<TextureLayer> layers; //Indexed like images
+	std::vector<GLuint> arrays;
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+
+//Hands the latest value from one producer thread to one consumer thread without locks.
+//The producer fills its own slot and swaps it into the middle, the consumer swaps the middle out when it is fresh,
+//so neither side ever sees a slot the other is still using. Nothing in here blocks, a side that paces itself against
+//the other checks acquire() or taken() and sleeps on a signal of its own between checks
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : writeIndex(0), middle(1), readIndex(2) {}
+
+	//Producer side: fill writeBuffer(), then publish() it
+	T& writeBuffer() { return slots[writeIndex]; }
+	void publish() {
+		writeIndex = middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+	//True once the consumer acquired the last published value
+	bool taken() const {
+		return (middle.load(std::memory_order_acquire) & FRESH) == 0;
+	}
+
+	//Consumer side: acquire() swaps in the newest published value, false when nothing new was published
+	bool acquire() {
+		if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+			return false;
+		}
+		readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+	T& readBuffer() { return slots[readIndex]; }
+
+private:
+	static const unsigned int INDEX_MASK = 3;
+	static const unsigned int FRESH = 4; //Set on the middle index when the producer published since the last acquire
+
+	T slots[3];
+	unsigned int writeIndex;
+	std::atomic<unsigned int> middle;
+	unsigned int readIndex;
+};